@@ -1,16 +1,38 @@
 #pragma once
 #include <iostream>   // cout, cin, endl
 #include <functional> // std::less<>()
-#include <utility>    // std::pair<>
+#include <utility>    // std::pair<>, std::forward
 #include <random>     // radom_device, mt19937, std::shuffle.
 #include <algorithm>  // std::copy
 #include <iterator>   // std::begin, std::end
-#include <exception>  // std::out_of_range
+#include <exception>  // std::out_of_range, std::exception_ptr
+#include <stdexcept>  // std::out_of_range, std::runtime_error
 #include <stack>      // std::stack
+#include <memory>     // std::allocator
+#include <new>        // placement new
+#include <queue>      // std::queue
+#include <deque>      // std::deque
+#include <thread>     // std::thread
+#include <system_error> // std::system_error
+#include <vector>     // std::vector
+#include <type_traits> // std::is_void, std::enable_if, std::decay
+#include <cstdint>    // uint64_t
+#include <cmath>      // std::log2
 #include <iomanip>    // std::setw()
 #include <initializer_list> // std::initializer_list
 #include <functional>
 
+#include "visitor.h"
+
+//! Asks the processor to start loading the cache line at `address`, without waiting for it.
+/*! Define `BST_DISABLE_PREFETCH` to compile the hints out, e.g. to measure what they bring.
+ */
+#if !defined( BST_DISABLE_PREFETCH ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define BST_PREFETCH( address ) __builtin_prefetch( address )
+#else
+#define BST_PREFETCH( address ) static_cast< void >( address )
+#endif
+
 
 //!  This class implements a generic Binary Search Tree.
 /*!
@@ -35,7 +57,15 @@ class BST
         //=== alias
         typedef std::function<bool(const KeyType& a, const KeyType& b) > KeyTypeLess; 
 
-    private:
+        typedef std::function<size_t(const KeyType& key) > KeyTypeHash; //!< Hashes keys for the lookup cache.
+
+        //! How lookups treat the tree shape.
+        enum class AccessPolicy {
+            STATIC, //!< Lookups never change the tree.
+            SPLAY   //!< Lookups splay the key they look for to the root of the tree.
+        };
+
+    protected:
         //=== Definition of a BST node.
         //! Represents a single binary search tree node.
         struct BTNode {
@@ -53,17 +83,80 @@ class BST
                 , right( rt_ )
                 { /* empty */ }
 
-            ~BTNode()
-            {
-                delete left;
-                delete right;
-            }
+            //! Constructor that takes over the key and the data it is given.
+            BTNode( KeyType && k_, ValueType && d_, BTNode * lt_, BTNode * rt_ )
+                : key( std::move( k_ ) )
+                , data( std::move( d_ ) )
+                , left( lt_ )
+                , right( rt_ )
+                { /* empty */ }
         };
 
-        BTNode *m_root; //!< Pointer to the root of the entire tree.
+        //! A released node slot, waiting to be reused. It overlays the storage of a BTNode.
+        struct FreeSlot {
+            FreeSlot *next; //!< The next released slot.
+        };
+
+        //! A block of raw storage nodes are carved from.
+        typedef std::pair< BTNode *, size_t > block_type;
+
+        //! A step of the insertion finger: a link on the path to the last hinted insertion.
+        /*! The subtree hanging from `slot` holds only keys that come after `lower`
+         *  and before `upper` (a null bound means no restriction on that side).
+         */
+        struct FingerStep {
+            BTNode **slot; //!< The link to the subtree.
+            const BTNode *lower; //!< Every key in the subtree comes after this node's key.
+            const BTNode *upper; //!< Every key in the subtree comes before this node's key (or is equivalent to it, in a MultiBST).
+        };
+
+        //! The state of a Day-Stout-Warren rebalance, which may be spread over several operations.
+        /*! The job first turns a subtree (or the whole tree) into a *vine*, a list of right links,
+         *  then folds it back with a series of compression passes, each one a run of left rotations
+         *  down the vine. Every step is a single rotation or a move down one link, so the tree
+         *  remains a valid BST between two steps, whatever insertions and removals happen in the
+         *  meantime; they may only make the final shape less balanced.
+         */
+        struct RebalanceJob {
+            //! What the job is doing.
+            enum class Phase {
+                IDLE,    //!< No rebalance in progress.
+                VINE,    //!< Turning the tree into a vine.
+                COMPRESS //!< Folding the vine into a balanced tree.
+            };
+
+            Phase phase; //!< What the job is doing.
+            BTNode *owner; //!< The parent of the subtree being rebalanced, or null if it is the whole tree.
+            bool owner_left; //!< Whether the subtree hangs from the left link of `owner`.
+            size_t budget; //!< The count of steps done by each operation.
+            BTNode *anchor; //!< The next step works on the right link of this node, or on the link to the subtree if null.
+            size_t vine_length; //!< The count of nodes in the vine so far.
+            size_t pass_left; //!< The count of rotations left in the current compression pass.
+            size_t pass_size; //!< The count of rotations of the next compression passes, halved after each one.
+        };
+
+        mutable BTNode *m_root; //!< Pointer to the root of the entire tree (lookups may splay it).
         size_t m_n_nodes; //!< The count of nodes stored in the tree.
         std::function<bool(const KeyType &, const KeyType &)> m_key_less; //!< The key comparator function object.
 
+        std::vector< block_type > m_blocks; //!< The storage blocks owned by the tree.
+        size_t m_capacity; //!< The count of node slots in all the blocks.
+        AccessPolicy m_access_policy; //!< How lookups treat the tree shape.
+
+        mutable std::vector< BTNode * > m_cache; //!< The lookup cache: recently found nodes, indexed by key hash. Empty if disabled.
+        unsigned m_cache_shift; //!< Turns a scrambled hash into a cache slot: `64 - log2( m_cache.size() )`.
+        KeyTypeHash m_cache_hash; //!< The hash function of the lookup cache.
+        mutable size_t m_cache_hits; //!< The count of lookups answered by the cache.
+        mutable size_t m_cache_misses; //!< The count of lookups that went down the tree.
+        FreeSlot *m_free_slots; //!< Slots released by removed nodes.
+        BTNode *m_bump; //!< The first never used slot of the last block.
+        BTNode *m_bump_end; //!< The end of the last block.
+        mutable std::vector< FingerStep > m_finger; //!< The path from the root to the last hinted insertion. Emptied whenever nodes move.
+        RebalanceJob m_rebalance; //!< The incremental rebalance in progress, if any.
+        double m_max_height_factor; //!< Incremental rebalancing starts once the height exceeds this factor times log2( size() ). 0 if disabled.
+        size_t m_rebalance_steps; //!< The count of rebalance steps done by each insertion or removal.
+        size_t m_max_depth; //!< An estimate of the height: the deepest insertion since the whole tree was last balanced.
+
 
         //=== INTERNAL MEMBERS
 
@@ -78,39 +171,107 @@ class BST
          */
         void insert( BTNode * & root, const KeyType & key, const ValueType & value );
 
+        //! Inserts a new pair <`key`,`value`>, starting from the insertion finger.
+        /*! @param keep_equal Whether a key already in the tree is inserted again, after the
+         *  equivalent ones (as MultiBST does), instead of being dropped.
+         *  @see insert_hint( const KeyType & , const ValueType & )
+         */
+        void insert_near_finger( const KeyType & key, const ValueType & value, bool keep_equal );
+
         //! Removes from the BST a node containing the requested key.
-        /*! Recursuvely tries to look for and remove from the BST
-         *  a node containing the requested key, if one is found in the tree.
+        /*! Looks for and removes from the BST a node containing the requested key,
+         *  if one is found in the tree.
          *  The deletion might modifiy the tree structure to preserve the
          *  BST properties.
          *  If the key is not found, nothing happens to the tree.
+         *  @tparam LookupKey Either KeyType or any type `less` can compare with KeyType.
+         *  @tparam Compare A function object that induces the same order as KeyTypeLess.
          *  @param root A pointer to the tree we want to operate on.
          *  @param key The key associated with the value we wish to operate on.
-         *  @param value The value we wish to store in the tree.
+         *  @param less The comparator used during the search.
          */
-        void remove( BTNode * & root, const KeyType & key );
+        template < typename LookupKey, typename Compare >
+        void remove( BTNode * & root, const LookupKey & key, const Compare & less );
 
-        //! Checks whether the BST contains a given key.
-        /*! Recursively search the `root` for the key provided.
-         *  Returns true if the key is found, or false otherwise.
+        //! Unlinks from the tree the node a link points to, and frees it.
+        /*! If the node has two children, the smallest key of its right subtree
+         *  takes its place, so that the BST properties are preserved.
+         *  @param slot The link to the node we want to remove; it must not be null.
+         */
+        void unlink( BTNode * & slot );
+
+        //! Looks for the node that stores a given key.
+        /*! Iteratively searches the `root` for the key provided.
+         *  Both children of a node are prefetched before its key is compared, so that the
+         *  next node is already on its way from memory when the comparison picks it; the
+         *  child is then selected without a branch.
+         *  @tparam LookupKey Either KeyType or any type `less` can compare with KeyType.
+         *  @tparam Compare A function object that induces the same order as KeyTypeLess.
          *  @param root A pointer to the tree we want to operate on.
          *  @param key The key we are looking for.
-         *  @return true if key is found in the tree, false otherwise.
-         *  @see contains( const KeyType & ) const
+         *  @param less The comparator used during the search.
+         *  @return A pointer to the node that stores `key`, or `nullptr` if the key is not in the tree.
          */
-        bool contains( const BTNode * root , const KeyType & key ) const;
+        template < typename LookupKey, typename Compare >
+        const BTNode * find_node( const BTNode * root, const LookupKey & key, const Compare & less ) const;
 
-        //! Retrieves in `value` the value associated with the provided key.
-        /*! Recursively tries to retrieve from the `root` BST the value associated
-         *  with the provided key, if one is found.
-         *  The retrieved value is stored in the output reference parameter `value`.
+        //! Looks for the node with the first key that does not come before a given key.
+        /*! @tparam LookupKey Either KeyType or any type `less` can compare with KeyType.
+         *  @tparam Compare A function object that induces the same order as KeyTypeLess.
          *  @param root A pointer to the tree we want to operate on.
          *  @param key The key we are looking for.
-         *  @param value The value associated with the target key.
-         *  @return true if key is found in the tree and the data is retrieved in value, false otherwise.
-         *  @see retrieve( const KeyType & , ValueType & ) const
+         *  @param less The comparator used during the search.
+         *  @return A pointer to the node found, or `nullptr` if every key comes before `key`.
+         */
+        template < typename LookupKey, typename Compare >
+        const BTNode * lower_bound_node( const BTNode * root, const LookupKey & key, const Compare & less ) const;
+
+        //! Looks for the link that points, or should point, to the node with a given key.
+        /*! Descends the tree only once. If the key is in the tree the returned link
+         *  points to its node; otherwise the returned link is the null pointer where a
+         *  node with that key should be attached, so that the caller may insert right away.
+         *  @tparam LookupKey Either KeyType or any type `less` can compare with KeyType.
+         *  @tparam Compare A function object that induces the same order as KeyTypeLess.
+         *  @param root The link to the tree we want to operate on.
+         *  @param key The key we are looking for.
+         *  @param less The comparator used during the search.
+         *  @return A reference to the link to the node (existing or not) with `key`.
+         */
+        template < typename LookupKey, typename Compare >
+        BTNode * & find_slot( BTNode * & root, const LookupKey & key, const Compare & less );
+        //! Same as find_slot(), also counting in `depth` the levels of the link found (1 for the root link).
+        template < typename LookupKey, typename Compare >
+        BTNode * & find_slot( BTNode * & root, const LookupKey & key, const Compare & less, size_t & depth );
+
+        //! Looks for the node that stores a given key, according to the access policy.
+        /*! With AccessPolicy::SPLAY the key (or the last node visited, if the key is not in the tree)
+         *  is splayed to the root of the tree first.
+         *  @param key The key we are looking for.
+         *  @return A pointer to the node that stores `key`, or `nullptr` if the key is not in the tree.
+         */
+        BTNode * access( const KeyType & key ) const;
+
+        //! Returns the lookup cache slot for a key.
+        size_t cache_slot( const KeyType & key ) const;
+
+        //! Drops from the lookup cache the entry for a key, if any.
+        /*! Called before the node of `key` is destroyed or gets another key.
+         */
+        void forget_cached( const KeyType & key );
+
+        //! Drops every entry of the lookup cache, keeping it enabled.
+        void forget_all_cached( void );
+
+        //! Splays a key to the root of a tree.
+        /*! Top-down splaying: walks down from the root towards `key`, rotating pairs of nodes
+         *  along the way, and reassembles the tree with the node where the search stopped at the root.
+         *  Keys accessed often end up near the root, while any sequence of m splays costs
+         *  O((m + n) log n) in total.
+         *  @param root A pointer to the tree we want to operate on; it must not be null.
+         *  @param key The key we are looking for.
+         *  @return A pointer to the new root of the tree.
          */
-        bool retrieve( const BTNode * root , const KeyType & key, ValueType & value ) const ;
+        BTNode * splay( BTNode * root, const KeyType & key ) const;
 
         //! Removes all the elements from the BST.
         /*! Recursively deletes all the nodes of the BST pointed by `root`.
@@ -121,63 +282,302 @@ class BST
          */
         void clear( BTNode * & root );
 
+        //=== Node storage members
+        //! Creates a new node in the storage owned by the tree.
+        /*! Reuses a released slot if there is one, otherwise takes the next unused slot of the
+         *  last block, allocating a new block (as large as all the current ones together) if needed.
+         *  @param key The key of the new node.
+         *  @param value The value of the new node.
+         *  @return A pointer to the new node, with no children.
+         */
+        BTNode * create_node( const KeyType & key, const ValueType & value );
+
+        //! Destroys a node created by create_node(), keeping its slot for future nodes.
+        void destroy_node( BTNode * node );
+
+        //! Allocates a block of `n` node slots owned by the tree, all of them unused.
+        BTNode * allocate_block( size_t n );
+
+        //! Returns every storage block to the system.
+        /*! All the nodes must have been destroyed beforehand.
+         */
+        void release_blocks( void );
+
+        //! Lists the nodes of a tree in **van Emde Boas** order.
+        /*! The tree is cut at half its height: the top half is listed first, recursively in
+         *  the same order, followed by each subtree hanging from it, from left to right.
+         *  Only nodes less than `levels` levels below `root` are listed.
+         *  @param root A pointer to the root of the tree we want to list.
+         *  @param levels The number of levels to list.
+         *  @param order Receives the nodes.
+         */
+        static void veb_order( BTNode * root, size_t levels, std::vector< BTNode * > & order );
+
+        //! Builds at `where` a node with the key, data and links of `node`, moving the key and data out.
+        /*! Used only when moving the key and the data cannot throw.
+         */
+        static void relocate_node( BTNode * where, BTNode & node, std::true_type );
+        //! Builds at `where` a copy of `node`, which is left untouched should the copy throw.
+        static void relocate_node( BTNode * where, BTNode & node, std::false_type );
+
+        //! Returns the number of levels of a tree, 0 for an empty tree.
+        static size_t height( const BTNode * root );
+
+        //! Returns the number of levels of a perfectly balanced tree of `n_nodes` nodes.
+        static size_t balanced_height( size_t n_nodes );
+
+        //! Returns the number of nodes of a (sub)tree.
+        static size_t count_nodes( const BTNode * root );
+
+        //! Returns the number of levels a tree of `n_nodes` nodes may have before incremental rebalancing steps in.
+        /*! That is `m_max_height_factor * log2( n_nodes + 1 )`, but never less than one level
+         *  above a balanced tree, so that a tree just rebalanced is always within the limit.
+         */
+        size_t height_limit( size_t n_nodes ) const;
+
+        //! Records the depth of a newly inserted node, then does some incremental rebalancing.
+        /*! If the node lies deeper than height_limit( size() ), a rebalance of the smallest
+         *  subtree on its path that is too tall for its own size starts, in the manner of a
+         *  scapegoat tree.
+         *  @param node The new node.
+         *  @param depth The level of the new node, 1 for the root.
+         */
+        void note_insertion( const BTNode * node, size_t depth );
+
+        //! Does the share of incremental rebalancing of an insertion or removal, if enabled.
+        /*! Starts a rebalance of the whole tree once the estimated height exceeds height_limit( size() ),
+         *  then runs the steps of the rebalance in progress that fall to one operation.
+         */
+        void rebalance_some( void );
+
+        //! Starts a rebalance of a subtree, dropping the one in progress if any.
+        /*! Each following operation does `m_rebalance_steps` steps, or more for a large subtree,
+         *  so that the subtree is a vine for a few operations only.
+         *  @param owner The parent of the subtree, or null to rebalance the whole tree.
+         *  @param owner_left Whether the subtree hangs from the left link of `owner`.
+         *  @param n_nodes The number of nodes of the subtree.
+         */
+        void start_rebalance( BTNode * owner, bool owner_left, size_t n_nodes );
+
+        //! Returns the link to the subtree being rebalanced.
+        BTNode ** rebalance_top( void );
+
+        //! Drops the rebalance in progress, if any; called whenever nodes move or are freed in bulk.
+        void abandon_rebalance( void );
+
+        //! Runs one step of the rebalance in progress.
+        /*! @return true if the rebalance is still in progress afterwards, false if it is over.
+         */
+        bool rebalance_step( void );
+
+        //! Frees all the nodes of a (sub)tree.
+        /*! Iteratively deletes every node reachable from `root`, in a single pass,
+         *  without recursion.
+         *  The count of nodes is **not** updated.
+         *  @param root A pointer to the root of the (sub)tree we want to free.
+         *  @return The number of nodes freed.
+         */
+        size_t free_subtree( BTNode * root );
+
+        //! Splits a tree in two according to a key predicate.
+        /*! Distributes the nodes of `root` into two trees: `first` receives the nodes whose keys
+         *  satisfy `goes_first`, and `second` receives the remaining nodes.
+         *  The predicate must be monotone with respect to the key order, i.e. if it holds for a key,
+         *  it holds for every key that comes before it.
+         *  Runs in O(h), where h is the height of the tree, since whole subtrees are moved at once.
+         *  @tparam KeyPredicate A function object of the form `std::function<bool( const KeyType  & )>`.
+         *  @param root A pointer to the tree we want to split. 
+         *  @param goes_first The predicate that selects the keys of the first tree.
+         *  @param first Receives the tree with the keys that satisfy `goes_first`.
+         *  @param second Receives the tree with the keys that do not satisfy `goes_first`.
+         */
+        template < typename KeyPredicate >
+        void split( BTNode * root, const KeyPredicate & goes_first, BTNode * & first, BTNode * & second );
+
+        //! Joins two trees into one.
+        /*! We assume every key in `first` comes before every key in `second`.
+         *  The largest key of `first` becomes the root, with the rest of `first` and `second`
+         *  as its subtrees, so the joined tree is at most one level taller than the taller input.
+         *  Runs in O(h), where h is the height of `first`.
+         *  @param first A pointer to the tree with the smaller keys.
+         *  @param second A pointer to the tree with the larger keys.
+         *  @return A pointer to the joined tree.
+         */
+        BTNode * join( BTNode * first, BTNode * second );
+
         //! Creates a copy of a BST tree.
         /*! Creates and returns an entire new tree that is a *deep copy*
          *  of the original BST passed in as argument.
-         *  By deep copy we mean that new nodes are allocated, and all the
-         *  key-value pairs are replicated on the new tree, preserving the
-         *  same tree structure.
+         *  By deep copy we mean that the key-value pairs are replicated on the
+         *  new tree, preserving the same tree structure.
+         *  The copy is iterative, so skewed trees do not overflow the call stack.
+         *  The nodes in `recycled` are used first, their key and value being assigned
+         *  rather than rebuilt; the other ones are carved from a single block, in preorder.
+         *  Recycled nodes that are not needed are destroyed, and `recycled` is emptied.
+         *  If a copy throws, the nodes copied so far are freed as well.
          *  @param root A pointer to the root of the tree we want to clone from.
+         *  @param n_nodes The number of nodes of that tree.
+         *  @param recycled Detached nodes of this tree that may hold the copy.
          *  @return A pointer to the cloned tree.
          */
-        BTNode * clone( const BTNode * root );
+        BTNode * clone( const BTNode * root, size_t n_nodes, std::vector< BTNode * > & recycled );
+
+        //! Copies a tree into a new block of its own, in preorder.
+        /*! Meant to run on a thread of its own: it does not touch the tree state.
+         *  On failure, the block is freed before the exception propagates.
+         *  @param root A pointer to the root of the tree we want to clone from; it must not be null.
+         *  @param block Receives the block, all of whose slots hold a node of the copy.
+         *  @return A pointer to the cloned tree, which is the first node of `block`.
+         */
+        static BTNode * clone_block( const BTNode * root, block_type & block );
+
+        //! Copies a tree in preorder, iteratively, making each node with `make_node`.
+        /*! Each copy is linked into the new tree as soon as it is made, so that
+         *  the nodes copied so far can be reached from `copy` if `make_node` throws.
+         *  @tparam NodeFactory A function object of the form `std::function<BTNode *( const BTNode & )>`,
+         *  returning a node with the key and value of its argument and no children.
+         *  @param root A pointer to the root of the tree we want to clone from.
+         *  @param copy Receives the root of the copy.
+         *  @param make_node The function object that makes the nodes of the copy.
+         */
+        template < typename NodeFactory >
+        static void copy_preorder( const BTNode * root, BTNode * & copy, const NodeFactory & make_node );
+
+        //! Makes sure the last block has `n` unused slots in a row, allocating a block of exactly `n` if needed.
+        /*! The unused slots of the previous block, if any, are released for future insertions.
+         */
+        void reserve_contiguous( size_t n );
+
+        //! Copies the comparator, the access policy and the lookup cache setup of another tree.
+        void copy_settings( const BST & other );
+
+        //=== Bulk construction members
+        //! Fills an empty tree with the pairs of `pairs`, building a perfectly balanced tree.
+        /*! The pairs are sorted (in parallel, for at least `parallel_build_threshold` pairs),
+         *  the pairs with a key equivalent to an earlier one are dropped, as insert() would,
+         *  and the nodes are built, at the same time on several threads, in a single block
+         *  where they are stored in key order. The links are finally set up, the middle
+         *  pair of each range becoming the root of its subtree.
+         *  The comparator must be safe to call from several threads at the same time.
+         *  @param pairs The key-value pairs to store; they are reordered.
+         */
+        void bulk_build( std::vector< std::pair< KeyType, ValueType > > & pairs );
+
+        //! Sorts key-value pairs by key, keeping the order of the pairs with equivalent keys.
+        /*! The pairs are cut into `n_threads` runs, sorted at the same time, and then
+         *  merged two by two, each round of merges also running at the same time.
+         *  @param pairs The pairs to sort.
+         *  @param n_threads The number of threads to use.
+         */
+        void parallel_sort( std::vector< std::pair< KeyType, ValueType > > & pairs, unsigned n_threads ) const;
+
+        //! Links nodes stored in key order into a perfectly balanced tree.
+        /*! @param nodes The nodes, in key order.
+         *  @param n_nodes The number of nodes.
+         *  @param spawn_depth The number of levels under which one of the two subtrees is linked on another thread.
+         *  @return The root of the tree.
+         */
+        static BTNode * link_balanced( BTNode * nodes, size_t n_nodes, unsigned spawn_depth );
+
+        //! Runs `task( 0 )`, ..., `task( n_tasks - 1 )` at the same time, each one on a thread of its own.
+        /*! The calling thread runs the first task; if a thread cannot be started,
+         *  its task runs on the calling thread as well. Once every task is over,
+         *  the first exception thrown by a task, if any, is rethrown.
+         *  @tparam Task A function object of the form `std::function<void( size_t )>`.
+         *  @param n_tasks The number of tasks.
+         *  @param task The function object to run.
+         */
+        template < typename Task >
+        static void run_in_parallel( size_t n_tasks, const Task & task );
 
         //=== Tree traversal members
         //! Traverses and visits each BST node in **preorder** fashion.
-        /*! Recursively traverses the BST in **preorder** while applying an unary function to
-         *  the value field of each node.
+        /*! Iteratively traverses the BST in **preorder** while applying a function to
+         *  the key-value pair (or only the value field) of each node.
          *  This strategy is knows as [**the visitor design pattern**](https://en.wikipedia.org/wiki/Visitor_pattern), which
          *  enables the client code freedom to specify what to do to each
          *  data node, according to application needs.
-         *  @tparam UnaryFunction A function object of the form `std::function<void( const ValueType  & )>`.
+         *  An explicit stack replaces the call stack, so degenerate trees do not overflow it.
+         *  @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting().
          *  @param root A pointer to the root of the tree we want to traverse.
-         *  @param visit The function object to be applied to each value stored in the BST.
-         *  @see preorder( const UnaryFunction & ) const
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @return true if every node has been visited, false if `visit` stopped the traversal.
+         *  @see preorder( Function && ) const
          */
-        template < typename UnaryFunction >
-        void preorder( const BTNode * root, const UnaryFunction & visit ) const ;
+        template < typename NodePointer, typename Function >
+        static bool preorder( NodePointer root, Function & visit );
 
         //! Traverses and visits each BST node in **postorder** fashion.
-        /*! Recursively traverses the BST in **postorder** while applying an unary function to
-         *  the value field of each node.
+        /*! Iteratively traverses the BST in **postorder** while applying a function to
+         *  the key-value pair (or only the value field) of each node.
          *  This strategy is knows as [**the visitor design pattern**](https://en.wikipedia.org/wiki/Visitor_pattern), which
          *  enables the client code freedom to specify what to do to each
          *  data node, according to application needs.
-         *  @tparam UnaryFunction A function object of the form `std::function<void( const ValueType  & )>`.
+         *  @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting().
          *  @param root A pointer to the root of the tree we want to traverse.
-         *  @param visit The function object to be applied to each value stored in the BST.
-         *  @see postorder( const UnaryFunction & ) const
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @return true if every node has been visited, false if `visit` stopped the traversal.
+         *  @see postorder( Function && ) const
          */
-        template < typename UnaryFunction >
-        void postorder( const BTNode * root, const UnaryFunction & visit ) const ;
+        template < typename NodePointer, typename Function >
+        static bool postorder( NodePointer root, Function & visit );
 
         //! Traverses and visits each BST node in **inorder** fashion.
-        /*! Recursively traverses the BST in **inorder** while applying an unary function to
-         *  the value field of each node.
+        /*! Iteratively traverses the BST in **inorder** while applying a function to
+         *  the key-value pair (or only the value field) of each node.
          *  This strategy is knows as [**the visitor design pattern**](https://en.wikipedia.org/wiki/Visitor_pattern), which
          *  enables the client code freedom to specify what to do to each
          *  data node, according to application needs.
-         *  @tparam UnaryFunction A function object of the form `std::function<void( const ValueType  & )>`.
+         *  @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting().
          *  @param root A pointer to the root of the tree we want to traverse.
-         *  @param visit The function object to be applied to each value stored in the BST.
-         *  @see inorder( const UnaryFunction & ) const
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @return true if every node has been visited, false if `visit` stopped the traversal.
+         *  @see inorder( Function && ) const
          */
-        template < typename UnaryFunction >
-        void inorder( const BTNode * root, const UnaryFunction & visit ) const ;
+        template < typename NodePointer, typename Function >
+        static bool inorder( NodePointer root, Function & visit );
+
+        //! Traverses and visits each BST node in **level order** (breadth-first) fashion.
+        /*! Visits the nodes level by level, from the root downwards,
+         *  left subtrees before right subtrees within a level.
+         *  @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting().
+         *  @param root A pointer to the root of the tree we want to traverse.
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @return true if every node has been visited, false if `visit` stopped the traversal.
+         *  @see levelorder( Function && ) const
+         */
+        template < typename NodePointer, typename Function >
+        static bool levelorder( NodePointer root, Function & visit );
+
+        //! Visits, in **inorder**, the nodes whose keys lie in the range `[lo, hi]`.
+        /*! @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting().
+         *  @param root A pointer to the root of the tree we want to traverse.
+         *  @param lo The first key of the range (inclusive).
+         *  @param hi The last key of the range (inclusive).
+         *  @param visit The function object to be applied to each node in range.
+         *  @see for_each_in_range( const KeyType & , const KeyType & , Function && ) const
+         */
+        template < typename NodePointer, typename Function >
+        void for_each_in_range( NodePointer root, const KeyType & lo, const KeyType & hi, Function & visit ) const ;
+
+        //! Traverses the tree in **inorder**, handing the values to `visit` in chunks.
+        /*! @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting_chunk().
+         *  @param root A pointer to the root of the tree we want to traverse.
+         *  @param visit The function object to be applied to each chunk of values.
+         *  @see inorder_chunks( Function && ) const
+         */
+        template < typename NodePointer, typename Function >
+        static void inorder_chunks( NodePointer root, Function & visit );
 
         //! Returns a pointer to the BST node with the smallest key value.
         /*!
-         * Helper method needed by remove() when the target node has 2 children.
+         * Helper method needed by find_min().
          * @param root Pointer to the root node of a tree.
          * @return A pointer to a leaf with the smallest key (left most leaf).
          */
@@ -186,6 +586,22 @@ class BST
     public:
         //=== alias
         typedef std::pair<KeyType, ValueType> node_content_type; //!< Represents a pair of key-value elements.
+        static const size_t chunk_size = 64; //!< The largest chunk of values handed over by inorder_chunks().
+        static const size_t parallel_clone_threshold = 1 << 16; //!< The smallest tree assign() copies in parallel.
+        static const size_t parallel_build_threshold = 1 << 16; //!< The smallest input the range constructor sorts and builds in parallel.
+        static const size_t rebalance_window = 16; //!< The count of operations an incremental rebalance is spread over, at most, unless `steps_per_operation` is too small.
+
+        //! How the memory of a BST is spent, in bytes. See memory_usage().
+        struct MemoryUsage {
+            size_t payload;     //!< The keys and values of the stored nodes.
+            size_t pointers;    //!< The child links of the stored nodes.
+            size_t padding;     //!< The alignment padding inside the stored nodes.
+            size_t slack;       //!< The node slots allocated but not in use: freed by removals, or never used yet.
+            size_t bookkeeping; //!< The tree object itself, its list of blocks, lookup cache and finger.
+
+            //! Returns the sum of all the parts.
+            size_t total( void ) const { return payload + pointers + padding + slack + bookkeeping; }
+        };
         //=== special member
         //! Default constructor.
         /*!
@@ -196,6 +612,18 @@ class BST
             : m_root( nullptr )
             , m_n_nodes(0)
             , m_key_less ( comp )
+            , m_capacity( 0 )
+            , m_access_policy( AccessPolicy::STATIC )
+            , m_cache_shift( 0 )
+            , m_cache_hits( 0 )
+            , m_cache_misses( 0 )
+            , m_free_slots( nullptr )
+            , m_bump( nullptr )
+            , m_bump_end( nullptr )
+            , m_rebalance( RebalanceJob{ RebalanceJob::Phase::IDLE, nullptr, false, 0, nullptr, 0, 0, 0 } )
+            , m_max_height_factor( 0 )
+            , m_rebalance_steps( 0 )
+            , m_max_depth( 0 )
             {/* empty */}
 
         //! Copy constructor.
@@ -207,7 +635,8 @@ class BST
          *  key-value pairs are replicated on the new tree, preserving the
          *  same tree structure.
          *  @param other The BST we are copying-constructing from.
-         *  @see clone( const BTNode *)
+         *  All the nodes are allocated in a single block.
+         *  @see clone( const BTNode * , size_t , std::vector< BTNode * > & )
          */
         BST( const BST & other ) ;
 
@@ -225,8 +654,10 @@ class BST
          *  range is of the type BST::node_content_type.
          *  If multiple elements in the range have keys that compare equivalent,
          *  only the first instance of the pair key-value is inserted.
+         *  The tree is built perfectly balanced, using several threads for large ranges.
          *
          *  @tparam InputItr The input iterator to the range we insert from.
+         *  @see bulk_build( std::vector< std::pair< KeyType, ValueType > > & )
          *  @param first the begining of the range to copy from.
          *  @param last the end (exclusive) of the range to copy from.
          *  @param comp The function object necessary to compare keys.
@@ -243,6 +674,7 @@ class BST
          *  list is of the type BST::node_content_type.
          *  If multiple elements in the initialize list have keys that compare equivalent,
          *  only the first instance of the pair key-value is inserted.
+         *  The tree is built perfectly balanced, as by the range constructor.
          *
          *  @param init The initializer list to initialize the elements of the BST with.
          *  @param comp The function object necessary to compare keys.
@@ -255,15 +687,30 @@ class BST
          *  The BST copy assignment operator.
          *  This operator replaces the current BST content with a *deep copy* of
          *  the elements from the `rhs` BST. 
-         *  By deep copy we mean that new nodes are allocated, and all the
-         *  key-value pairs are replicated on the new tree, preserving the
-         *  same tree structure.
+         *  By deep copy we mean that all the key-value pairs are replicated
+         *  on this tree, preserving the same tree structure.
+         *  The nodes this tree already has are reused, their keys and values being
+         *  assigned from `rhs`, before new nodes are allocated (in a single block).
          *
          *  @param rhs The BST container to use as data source.
          *  @return `*this` to enable chained assignments.
+         *  @see assign( const BST & , unsigned )
          */
         BST & operator=( const BST & rhs );
 
+        //! Replaces the contents with a copy of `rhs`, cloning large subtrees in parallel.
+        /*!
+         *  Same as the copy assignment, except that, when `rhs` holds at least
+         *  `parallel_clone_threshold` nodes and `n_threads > 1`, the top of the tree is
+         *  copied first, down to about `n_threads` subtrees, which are then copied at the
+         *  same time, each one on its own thread and into its own storage block.
+         *  Only the nodes are copied concurrently: `rhs` must not change meanwhile.
+         *
+         *  @param rhs The BST container to use as data source.
+         *  @param n_threads The largest number of threads to use.
+         */
+        void assign( const BST & rhs, unsigned n_threads );
+
         //! The initializer list assignment operator.
         /*!
          *  The BST initializer list assignment operator.
@@ -273,6 +720,7 @@ class BST
          *  list is of the type BST::node_content_type.
          *  If multiple elements in the initialize list have keys that compare equivalent,
          *  only the first instance of the pair key-value is inserted.
+         *  The tree is rebuilt perfectly balanced, as by the range constructor.
          *
          *  @param ilist The initialize list to use as data source.
          *  @return `*this` to enable chained assignments.
@@ -289,10 +737,41 @@ class BST
         /*! Returns true if the BST contains a given key, or false otherwise.
          *  @param key The key we are looking for.
          *  @return true if key is found in the tree, false otherwise.
-         *  @see contains( const BTNode * , const KeyType & ) const
+         *  @see access( const KeyType & ) const
          */
         bool contains( const KeyType & key ) const;
 
+        //! Selects how lookups treat the tree shape.
+        /*! With AccessPolicy::SPLAY, contains(), retrieve(), find() and at() move the key they
+         *  look for to the root of the tree, so that frequently accessed keys stay near the root.
+         *  This pays off on skewed workloads, where a few keys take most of the lookups,
+         *  but it means lookups modify the tree: concurrent lookups on the same tree are not safe,
+         *  and pointers returned by find() stay valid but may point deep into the tree later on.
+         *  The default policy is AccessPolicy::STATIC.
+         *  @param policy The new access policy.
+         */
+        void set_access_policy( AccessPolicy policy ) { m_access_policy = policy; }
+        //! Returns the current access policy.
+        AccessPolicy access_policy( void ) const { return m_access_policy; }
+
+        //! Puts a small lookup cache in front of the tree.
+        /*! The cache remembers the nodes recently found by contains(), retrieve(), find() and at(),
+         *  in a fixed-size table indexed by key hash, so that repeated lookups of hot keys take O(1)
+         *  instead of a walk down the tree. Colliding keys simply replace each other.
+         *  Insertions and removals keep the cache coherent. As with the splay policy, lookups then
+         *  update the tree object, so concurrent lookups on the same tree are not safe.
+         *  Calling this method again resizes the cache and resets its counters.
+         *  @param n_slots The number of cache entries, rounded up to a power of two.
+         *  @param hash The function object used to hash keys.
+         */
+        void enable_lookup_cache( size_t n_slots, const KeyTypeHash & hash = std::hash< KeyType >() );
+        //! Removes the lookup cache.
+        void disable_lookup_cache( void );
+        //! Returns the count of lookups answered by the lookup cache.
+        size_t cache_hits( void ) const { return m_cache_hits; }
+        //! Returns the count of lookups the lookup cache could not answer.
+        size_t cache_misses( void ) const { return m_cache_misses; }
+
         //! Returns true if the BST is empty, or false otherwise.
         inline bool empty( void ) const { return m_n_nodes == 0; };
         //! Returns the number of key-value elements stored in the BST.
@@ -304,49 +783,210 @@ class BST
          *  @param key The key we are looking for.
          *  @param value The value associated with the target key we copied into.
          *  @return true if key is found in the tree and the data is retrieved in value, false otherwise.
-         *  @see retrieve( const BTNode * , const KeyType & , ValueType & ) const
+         *  @see access( const KeyType & ) const
          */
         bool retrieve( const KeyType & key, ValueType & value ) const;
 
+        //! Returns a pointer to the value associated with the provided key.
+        /*! Unlike retrieve(), the value is not copied.
+         *  The pointer remains valid until the node is removed from the tree.
+         *  @param key The key we are looking for.
+         *  @return A pointer to the value associated with `key`, or `nullptr` if the key is not in the tree.
+         */
+        const ValueType * find( const KeyType & key ) const;
+        //! Returns a pointer to the (modifiable) value associated with the provided key.
+        ValueType * find( const KeyType & key );
+
+        //! Returns a reference to the value associated with the provided key.
+        /*! @param key The key we are looking for.
+         *  @return A reference to the value associated with `key`.
+         *  @throw std::out_of_range if the key is not in the tree.
+         */
+        const ValueType & at( const KeyType & key ) const;
+        //! Returns a reference to the (modifiable) value associated with the provided key.
+        ValueType & at( const KeyType & key );
+
+        //! Returns a reference to the value associated with the provided key, inserting it if needed.
+        /*! If the key is not in the tree, a new node with <`key`,`ValueType()`> is inserted first.
+         *  The tree is descended only once.
+         *  @param key The key we are looking for.
+         *  @return A reference to the value associated with `key`.
+         */
+        ValueType & operator[]( const KeyType & key );
+
+        //! Returns a reference to the value associated with the provided key, inserting it if needed.
+        /*! If the key is not in the tree, a new node with <`key`,`value`> is inserted first;
+         *  otherwise the stored value is left untouched.
+         *  The tree is descended only once.
+         *  @param key The key we are looking for.
+         *  @param value The value to be stored if the key is not in the tree yet.
+         *  @return A reference to the value associated with `key`.
+         */
+        ValueType & get_or_insert( const KeyType & key, const ValueType & value );
+
+        //! Returns a pointer to the value associated with the first key that does not come before `key`.
+        /*! Follows the order induced by KeyTypeLess.
+         *  @param key The key we are looking for.
+         *  @return A pointer to the value found, or `nullptr` if every key in the tree comes before `key`.
+         */
+        const ValueType * lower_bound( const KeyType & key ) const;
+
+        //=== heterogeneous lookup members
+        //
+        // The members below accept a key of any type `LookupKey` that can be compared
+        // with KeyType, so that, say, a `const char *` may look up a `std::string` key
+        // without building a temporary `std::string`.
+        // The comparator `comp` must declare the member type `is_transparent`, be callable
+        // as `comp( KeyType, LookupKey )` and `comp( LookupKey, KeyType )`, and induce
+        // the same order as the KeyTypeLess of the tree. These overloads do not take part in
+        // overload resolution for comparators that do not declare `is_transparent`.
+
+        //! Checks whether the BST contains a key equivalent to `key`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+        contains( const LookupKey & key, const Compare & comp ) const;
+
+        //! Retrieves in `value` the value associated with a key equivalent to `key`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+        retrieve( const LookupKey & key, ValueType & value, const Compare & comp ) const;
+
+        //! Returns a pointer to the value associated with a key equivalent to `key`, or `nullptr`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+        find( const LookupKey & key, const Compare & comp ) const;
+        //! Returns a pointer to the (modifiable) value associated with a key equivalent to `key`, or `nullptr`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, ValueType * >::type
+        find( const LookupKey & key, const Compare & comp );
+
+        //! Returns a pointer to the value associated with the first key that does not come before `key`, or `nullptr`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+        lower_bound( const LookupKey & key, const Compare & comp ) const;
+
+        //! Removes from the BST the node containing a key equivalent to `key`, if one is found.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value >::type
+        remove( const LookupKey & key, const Compare & comp );
+
         //=== tree traversal members
+        //
+        // Every traversal accepts two kinds of visitors: one that receives
+        // the key-value pair of a node, `( const KeyType & , ValueType & )`, and one that
+        // receives only the value field, `( ValueType & )`.
+        // The `const` overloads hand out `const ValueType &`, whereas the non-`const`
+        // ones allow the values to be updated in place. Keys are always `const`.
+        // If a visitor returns a `bool`, returning `false` stops the traversal right away.
+        // Visitors are taken by forwarding reference, so stateful function objects (counters,
+        // accumulators) can be passed as they are, and each traversal returns the visitor
+        // once it is done, as `std::for_each` does.
+
         //! Traverses and visits each BST node in **preorder** fashion.
-        /*! During the **preorder** BST traversal the method applies an unary function to
-         *  the value field of each visited node.
+        /*! During the **preorder** BST traversal the method applies a function to
+         *  each visited node.
          *  This strategy is knows as [**the visitor design pattern**](https://en.wikipedia.org/wiki/Visitor_pattern),
          *  which enables the client code to decouple the algorithm to be applied to each
          *  node from the BST structure.
-         *  @tparam UnaryFunction A function object of the form `std::function<void( const ValueType  & )>`.
-         *  @param visit The function object to be applied to each value stored in the BST.
-         *  @see preorder( const BTNode * , const UnaryFunction & ) const
+         *  @tparam Function A function object of the form `std::function<void( const KeyType &, const ValueType  & )>`
+         *  or `std::function<void( const ValueType  & )>`, optionally returning `bool`.
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @see preorder( NodePointer , Function & )
          */
-        template < typename UnaryFunction >
-        void preorder( const UnaryFunction & visit ) const ;
+        template < typename Function >
+        typename std::decay< Function >::type preorder( Function && visit ) const ;
+        //! Traverses the BST in **preorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type preorder( Function && visit );
 
         //! Traverses and visits each BST node in **postorder** fashion.
-        /*! During the **postorder** BST traversal the method applies an unary function to
-         *  the value field of each visited node.
+        /*! During the **postorder** BST traversal the method applies a function to
+         *  each visited node.
          *  This strategy is knows as [**the visitor design pattern**](https://en.wikipedia.org/wiki/Visitor_pattern), which
          *  enables the client code freedom to specify what to do to each
          *  data node, according to application needs.
-         *  @tparam UnaryFunction A function object of the form `std::function<void( const ValueType  & )>`.
-         *  @param visit The function object to be applied to each value stored in the BST.
-         *  @see postorder( const BTNode * , const UnaryFunction & ) const
+         *  @tparam Function A function object of the form `std::function<void( const KeyType &, const ValueType  & )>`
+         *  or `std::function<void( const ValueType  & )>`, optionally returning `bool`.
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @see postorder( NodePointer , Function & )
          */
-        template < typename UnaryFunction >
-        void postorder( const UnaryFunction & visit ) const ;
+        template < typename Function >
+        typename std::decay< Function >::type postorder( Function && visit ) const ;
+        //! Traverses the BST in **postorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type postorder( Function && visit );
 
         //! Traverses and visits each BST node in **inorder** fashion.
-        /*! During the **inorder** BST traversal the method applies an unary function to
-         *  the value field of each visited node.
+        /*! During the **inorder** BST traversal the method applies a function to
+         *  each visited node.
          *  This strategy is knows as [**the visitor design pattern**](https://en.wikipedia.org/wiki/Visitor_pattern), which
          *  enables the client code freedom to specify what to do to each
          *  data node, according to application needs.
-         *  @tparam UnaryFunction A function object of the form `std::function<void( const ValueType  & )>`.
-         *  @param visit The function object to be applied to each value stored in the BST.
-         *  @see inorder( const BTNode * , const UnaryFunction & ) const
+         *  @tparam Function A function object of the form `std::function<void( const KeyType &, const ValueType  & )>`
+         *  or `std::function<void( const ValueType  & )>`, optionally returning `bool`.
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @see inorder( NodePointer , Function & )
+         */
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit ) const ;
+        //! Traverses the BST in **inorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit );
+
+        //! Traverses and visits each BST node in **level order** fashion.
+        /*! During the **level order** (breadth-first) BST traversal the method applies a
+         *  function to each visited node, one tree level at a time.
+         *  @tparam Function A function object of the form `std::function<void( const KeyType &, const ValueType  & )>`
+         *  or `std::function<void( const ValueType  & )>`, optionally returning `bool`.
+         *  @param visit The function object to be applied to each node stored in the BST.
+         *  @see levelorder( NodePointer , Function & )
+         */
+        template < typename Function >
+        typename std::decay< Function >::type levelorder( Function && visit ) const ;
+        //! Traverses the BST in **level order**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type levelorder( Function && visit );
+
+        //! Visits, in **inorder**, the nodes whose keys lie in the range `[lo, hi]`.
+        /*! Only subtrees that may overlap the range are explored, so the cost is
+         *  O(h + k), where h is the height of the tree and k the number of keys in range.
+         *  The range bounds follow the order induced by KeyTypeLess.
+         *  @tparam Function A function object of the form `std::function<void( const KeyType &, const ValueType  & )>`
+         *  or `std::function<void( const ValueType  & )>`, optionally returning `bool`.
+         *  @param lo The first key of the range (inclusive).
+         *  @param hi The last key of the range (inclusive).
+         *  @param visit The function object to be applied to each node in range.
+         */
+        template < typename Function >
+        typename std::decay< Function >::type for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit ) const ;
+        //! Visits the nodes in the range `[lo, hi]`, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit );
+
+        //! Traverses the BST in **inorder**, handing the values over in chunks.
+        /*! The values are gathered, in inorder, into an array of up to `chunk_size` pointers, which
+         *  is passed to the visitor as `( const ValueType * const * values, size_t n )`, so that a chunk
+         *  is processed in one tight loop instead of one call per node.
+         *  As for the other traversals, a visitor returning `false` stops the traversal.
+         *  @tparam Function A function object of the form
+         *  `std::function<void( const ValueType * const *, size_t )>`, optionally returning `bool`.
+         *  @param visit The function object to be applied to each chunk of values.
+         *  @return The visitor.
+         */
+        template < typename Function >
+        typename std::decay< Function >::type inorder_chunks( Function && visit ) const ;
+        //! Traverses the BST in **inorder** chunks of `( ValueType * const * values, size_t n )`, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type inorder_chunks( Function && visit );
+
+        //! Returns the first value, in **inorder**, that satisfies a predicate.
+        /*! The underlying traversal stops as soon as a matching value is found.
+         *  @tparam UnaryPredicate A function object of the form `std::function<bool( const ValueType  & )>`.
+         *  @param pred The predicate each value is tested against.
+         *  @return A pointer to the first matching value, or `nullptr` if there is none.
          */
-        template < typename UnaryFunction >
-        void inorder( const UnaryFunction & visit ) const ;
+        template < typename UnaryPredicate >
+        const ValueType * find_if( const UnaryPredicate & pred ) const ;
 
 
         //=== MODIFIER MEMBERS
@@ -367,6 +1007,20 @@ class BST
          */
         void insert( const KeyType & key , const ValueType & value );
 
+        //! Inserts a new pair <`key`,`value`> in the tree, starting from the last hinted insertion.
+        /*! The tree remembers the path to the node created by the previous call (the *finger*).
+         *  Instead of descending from the root, the search climbs that path back only until it reaches
+         *  a subtree whose key range covers `key`, and descends from there.
+         *  When keys arrive in nearly sorted order, each new key lands next to the previous one,
+         *  and the insertion costs amortized O(1) comparisons instead of O(h).
+         *  Any other insertion keeps the finger valid; removals, splaying, relayout() and alike drop it,
+         *  so the next call starts over from the root.
+         *  As with insert(), nothing happens if the key is already stored in the tree.
+         *  @param key The key associated with the value we wish to operate on.
+         *  @param value The value we wish to store in the tree.
+         */
+        void insert_hint( const KeyType & key , const ValueType & value );
+
         //! Removes from the BST a node containing the requested key.
         /*! Removes from the BST a node containing the requested key if one
          *  is found in the tree.
@@ -375,11 +1029,98 @@ class BST
          *  If the key is not found, nothing happens to the tree.
          *  @param key The key associated with the value we wish to operate on.
          *  @param value The value we wish to store in the tree.
-         *  @see remove( BTNode * & , const KeyType & , const ValueType & )
+         *  @see remove( BTNode * & , const LookupKey & , const Compare & )
          */
         void remove( const KeyType & key );
 
 
+        //! Removes from the BST all the nodes whose keys lie in the range `[lo, hi]`.
+        /*! The tree is split around the range, the middle part is freed in a single pass,
+         *  and the remaining parts are joined back together.
+         *  The cost is O(h + k), where h is the height of the tree and k the number of keys removed.
+         *  @param lo The first key of the range (inclusive).
+         *  @param hi The last key of the range (inclusive).
+         *  @return The number of nodes removed.
+         *  @see split( BTNode * , const KeyPredicate & , BTNode * & , BTNode * & )
+         */
+        size_t erase_range( const KeyType & lo, const KeyType & hi );
+
+
+        //! Relocates all the nodes into a single block, in **van Emde Boas** order.
+        /*! The van Emde Boas layout stores the top half of the tree first, followed by each
+         *  of the subtrees hanging from it, each one laid out recursively in the same way.
+         *  Whatever the cache line or page size, a lookup then touches O(log_B n) blocks of
+         *  size B, instead of about one new block per level, which pays off on read-mostly trees.
+         *  The tree shape, and therefore the interface, is not affected, but all pointers
+         *  previously returned by find() and alike are invalidated.
+         *  The operation runs in O(n log h) time, where h is the height of the tree, and may be
+         *  repeated periodically, as insertions and removals degrade the layout.
+         *  Keys and values are moved if their move constructors cannot throw, and copied otherwise;
+         *  should a copy throw, the tree is left unchanged.
+         *  @see veb_order( BTNode * , size_t , std::vector< BTNode * > & )
+         */
+        void relayout( void );
+
+        //! Returns the number of levels of the tree, 0 for an empty tree.
+        /*! Runs in O(n), as every node is visited.
+         */
+        size_t height( void ) const { return height(m_root); }
+
+        //! Rebuilds the tree into a balanced shape, with the **Day-Stout-Warren** algorithm.
+        /*! The tree is turned into a vine by right rotations, then folded back by left rotations
+         *  into a tree whose levels are all full but the last one. It runs in O(n) time with
+         *  O(1) extra space, since nodes are only relinked, never moved or copied: pointers
+         *  returned by find() and alike stay valid. A rebalance in progress is completed.
+         */
+        void rebalance( void );
+
+        //! Turns on incremental rebalancing.
+        /*! Whenever a node lands deeper than `max_height_factor * log2( size() + 1 )` levels (and
+         *  at least one level deeper than a balanced tree would be), the smallest subtree on its
+         *  path that is too tall for its own size is rebuilt with the Day-Stout-Warren algorithm,
+         *  as in a scapegoat tree. The rebuild is spread over the following insertions and
+         *  removals, each one doing `steps_per_operation` steps (a rotation or a move down one
+         *  link), or more for a large subtree, so that it is over within `rebalance_window`
+         *  operations. Removals lower the limit: the whole tree is rebalanced once the deepest
+         *  insertion since it was last balanced goes past it.
+         *
+         *  The tree is then within the limit whenever no rebuild is in progress, sorted streams
+         *  included, for O(log n) amortized work per insertion. Keep in mind, though, that
+         *  finding the subtree counts its nodes, and that a subtree of m nodes costs up to
+         *  O(m / rebalance_window) steps per operation while it is rebuilt: large subtrees, up to
+         *  the whole tree, are rare but not free. While a rebuild runs, the part of the subtree
+         *  already turned into a vine is searched linearly, and nodes inserted too deep are only
+         *  taken care of by the next deep insertion after it.
+         *  Either way, lookups and traversals see a valid BST at all times.
+         *  @param max_height_factor How much taller than a balanced tree the tree may grow; 0 turns it off.
+         *  @param steps_per_operation The rebalancing work done by each insertion or removal, at least 4.
+         */
+        void enable_incremental_rebalance( double max_height_factor = 2.0, size_t steps_per_operation = 64 );
+        //! Turns off incremental rebalancing, dropping the rebalance in progress if any.
+        void disable_incremental_rebalance( void );
+        //! Returns true if an incremental rebalance is in progress.
+        bool rebalancing( void ) const { return m_rebalance.phase != RebalanceJob::Phase::IDLE; }
+
+        //! Tells how much memory the tree uses, broken down by purpose.
+        /*! Every node slot takes `sizeof( BTNode )` bytes: the key and the value, two child pointers,
+         *  and whatever padding the alignment of those members requires. Slots are carved from
+         *  blocks the tree allocates in bulk, so after removals, or while the last block fills up,
+         *  some of them sit unused: that is the slack, which shrink_to_fit() gives back.
+         *  Only `sizeof` is counted: memory owned by the keys or values themselves, such as the
+         *  characters of a long `std::string`, and the overhead of the system allocator per
+         *  block, are not included.
+         *  Runs in O(1).
+         */
+        MemoryUsage memory_usage( void ) const;
+
+        //! Gives the slack back to the system, moving all the nodes into a single block of the exact size.
+        /*! The nodes are laid out as by relayout(), so all pointers previously returned by find()
+         *  and alike are invalidated. The internal buffers shrink to fit as well.
+         *  Nothing moves if the tree has no slack. Worth calling after a large wave of removals.
+         *  @see relayout()
+         */
+        void shrink_to_fit( void );
+
         //=== FRIEND FUNCTION
         //! Prints out an ascii tree-bar representation of the BST.
         /*!
@@ -1,348 +1,2090 @@
 #include "bst.h"
 
+template < typename KeyType, typename ValueType >
+const size_t BST< KeyType, ValueType >::chunk_size;
+template < typename KeyType, typename ValueType >
+const size_t BST< KeyType, ValueType >::parallel_clone_threshold;
+template < typename KeyType, typename ValueType >
+const size_t BST< KeyType, ValueType >::parallel_build_threshold;
+template < typename KeyType, typename ValueType >
+const size_t BST< KeyType, ValueType >::rebalance_window;
+
 template < typename KeyType, typename ValueType >
 void BST< KeyType, ValueType >::insert( BTNode * & root, const KeyType & key, const ValueType & value )
 {
-	if(contains(root, key))
+    size_t depth = 0;
+    BTNode * & slot = find_slot(root, key, m_key_less, depth);
+
+    if(slot == nullptr)
     {
-        return;
+        slot = create_node(key, value);
+        m_n_nodes++;
+        note_insertion(slot, depth);
     }
-    else
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+void BST< KeyType, ValueType >::remove( BTNode * & root, const LookupKey & key, const Compare & less )
+{
+    BTNode * & slot = find_slot(root, key, less);
+
+    if(slot != nullptr)
     {
-        if(root == nullptr)
-        {
-            root = new BTNode(key, value, nullptr, nullptr);
-            m_n_nodes++;
-        }
-        else if(m_key_less(root->key, key))
-        {
-            insert(root->left, key, value);
-        }
-        else
-        {
-            insert(root->right, key, value);
-        }
+        unlink(slot);
     }
+    rebalance_some();
 }
 
 template < typename KeyType, typename ValueType >
-void BST< KeyType, ValueType >::remove( BTNode * & root, const KeyType & key )
+void BST< KeyType, ValueType >::unlink( BTNode * & slot )
 {
-    if(root == nullptr)
+    BTNode * target = slot;
+    forget_cached(target->key);
+    m_finger.clear();
+
+    if(target->left != nullptr && target->right != nullptr)
     {
-        return;
+        // Move the smallest key of the right subtree into the target, and unlink that node instead.
+        BTNode ** smallest = &target->right;
+        while((*smallest)->left != nullptr)
+        {
+            smallest = &(*smallest)->left;
+        }
+
+        forget_cached((*smallest)->key);
+        target->key = std::move((*smallest)->key);
+        target->data = std::move((*smallest)->data);
+
+        target = *smallest;
+        *smallest = target->right;
     }
-    if(m_key_less(root->key, key))
+    else
     {
-        remove(root->left, key);
+        slot = target->left != nullptr ? target->left : target->right;
     }
-    else if(!m_key_less(root->key, key) && !m_key_less(key, root->key))
+
+    if(target == m_rebalance.owner)
     {
-        if(root->left == nullptr && root->right == nullptr)
-        {
-            delete root;
-            root = nullptr;
-            m_n_nodes--;
-        }
-        else if(root->right == nullptr)
-        {
-            BTNode * temp = root;
-            root = root->left;
-            temp->left = nullptr;
-            temp->right = nullptr;
-            delete temp;
-            temp = nullptr;
-            m_n_nodes--;
-        }
-        else if (root->left == nullptr)
-        {
-            BTNode * temp = root;
-            root = root->right;
-            temp->left = nullptr;
-            temp->right = nullptr;
-            delete temp;
-            temp = nullptr;
-            m_n_nodes--;
-        }
-        else
+        abandon_rebalance(); // The subtree being rebalanced lost its parent.
+    }
+    else if(target == m_rebalance.anchor)
+    {
+        // The rebalance in progress cannot resume from a freed node: start the subtree over.
+        RebalanceJob & job = m_rebalance;
+        job = RebalanceJob{ RebalanceJob::Phase::VINE, job.owner, job.owner_left, job.budget, nullptr, 0, 0, 0 };
+    }
+    destroy_node(target);
+    m_n_nodes--;
+}
+
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::access( const KeyType & key ) const
+{
+    size_t slot = 0;
+    if(!m_cache.empty())
+    {
+        slot = cache_slot(key);
+        BTNode * cached = m_cache[slot];
+        if(cached != nullptr && !m_key_less(cached->key, key) && !m_key_less(key, cached->key))
         {
-            const BTNode * temp = get_smallest_leaf(root->right);
-            root->key = temp->key;
-            root->data = temp->data;
-            remove(root->right, temp->key);
+            m_cache_hits++;
+            return cached;
         }
+        m_cache_misses++;
+    }
 
+    BTNode * node;
+    if(m_access_policy == AccessPolicy::SPLAY && m_root != nullptr)
+    {
+        m_finger.clear();
+        m_root = splay(m_root, key);
+        bool found = !m_key_less(m_root->key, key) && !m_key_less(key, m_root->key);
+        node = found ? m_root : nullptr;
     }
     else
     {
-        remove(root->right, key);
+        node = const_cast< BTNode * >( find_node(m_root, key, m_key_less) );
+    }
+
+    if(node != nullptr && !m_cache.empty())
+    {
+        m_cache[slot] = node;
     }
 
-    return;
+    return node;
 }
 
 template < typename KeyType, typename ValueType >
-bool BST< KeyType, ValueType >::contains( const BTNode * root , const KeyType & key ) const
+size_t BST< KeyType, ValueType >::cache_slot( const KeyType & key ) const
 {
-    while(root != nullptr)
+    // Fibonacci hashing: scramble the hash, then keep its top bits.
+    uint64_t scrambled = static_cast< uint64_t >( m_cache_hash(key) ) * UINT64_C(11400714819323198485);
+    return static_cast< size_t >( scrambled >> m_cache_shift );
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::forget_cached( const KeyType & key )
+{
+    if(!m_cache.empty())
+    {
+        m_cache[cache_slot(key)] = nullptr;
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::forget_all_cached( void )
+{
+    std::fill(m_cache.begin(), m_cache.end(), nullptr);
+}
+
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::splay( BTNode * root, const KeyType & key ) const
+{
+    // Nodes known to be on the left (resp. right) side of the key are gathered in a
+    // separate tree; the hooks point to the link where the next such node goes.
+    BTNode * left_tree = nullptr;
+    BTNode * right_tree = nullptr;
+    BTNode ** left_hook = &left_tree;
+    BTNode ** right_hook = &right_tree;
+
+    while(true)
     {
         if(m_key_less(root->key, key))
         {
+            // The key is in the left subtree.
+            if(root->left == nullptr)
+            {
+                break;
+            }
+            if(m_key_less(root->left->key, key))
+            {
+                // Zig-zig: rotate right.
+                BTNode * child = root->left;
+                root->left = child->right;
+                child->right = root;
+                root = child;
+                if(root->left == nullptr)
+                {
+                    break;
+                }
+            }
+            // The root and its right subtree go to the right side.
+            *right_hook = root;
+            right_hook = &root->left;
             root = root->left;
         }
-        else if(!m_key_less(root->key, key) && !m_key_less(key, root->key))
+        else if(m_key_less(key, root->key))
         {
-            return true;
+            // The key is in the right subtree.
+            if(root->right == nullptr)
+            {
+                break;
+            }
+            if(m_key_less(key, root->right->key))
+            {
+                // Zag-zag: rotate left.
+                BTNode * child = root->right;
+                root->right = child->left;
+                child->left = root;
+                root = child;
+                if(root->right == nullptr)
+                {
+                    break;
+                }
+            }
+            // The root and its left subtree go to the left side.
+            *left_hook = root;
+            left_hook = &root->right;
+            root = root->right;
         }
         else
         {
-            root = root->right;
+            break;
         }
     }
 
-    return false;
+    // Reassemble the tree around the new root.
+    *left_hook = root->left;
+    *right_hook = root->right;
+    root->left = left_tree;
+    root->right = right_tree;
+
+    return root;
 }
 
 template < typename KeyType, typename ValueType >
-bool BST< KeyType, ValueType >::retrieve( const BTNode * root , const KeyType & key, ValueType & value ) const 
+template < typename LookupKey, typename Compare >
+const typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::find_node( const BTNode * root, const LookupKey & key, const Compare & less ) const
 {
     while(root != nullptr)
     {
-        if(m_key_less(root->key, key))
+        // Start loading both children while the keys are compared.
+        BST_PREFETCH(root->left);
+        BST_PREFETCH(root->right);
+
+        bool go_left = less(root->key, key);
+        if(!go_left && !less(key, root->key))
         {
-            root = root->left;
+            return root;
         }
-        else if(!m_key_less(root->key, key) && !m_key_less(key, root->key))
+        root = go_left ? root->left : root->right;
+    }
+
+    return nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+const typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::lower_bound_node( const BTNode * root, const LookupKey & key, const Compare & less ) const
+{
+    const BTNode * bound = nullptr;
+
+    while(root != nullptr)
+    {
+        BST_PREFETCH(root->left);
+        BST_PREFETCH(root->right);
+
+        if(less(root->key, key))
         {
-            value = root->data;
-            return true;
+            // The root comes before the key, look among the larger keys.
+            root = root->left;
         }
         else
         {
+            // The root is a candidate, but a smaller key might still qualify.
+            bound = root;
             root = root->right;
         }
     }
-    return false;
+
+    return bound;
 }
 
 template < typename KeyType, typename ValueType >
-void BST< KeyType, ValueType >::clear( BTNode * & root )
+template < typename LookupKey, typename Compare >
+typename BST< KeyType, ValueType >::BTNode * & BST< KeyType, ValueType >::find_slot( BTNode * & root, const LookupKey & key, const Compare & less )
 {
-     if(root != nullptr)
-    {
-        delete root;
-        root = nullptr;
-        m_n_nodes = 0;
-    }
-    else
-    {
-        return;
-    }
+    size_t depth;
+    return find_slot(root, key, less, depth);
 }
 
 template < typename KeyType, typename ValueType >
-typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::clone( const BTNode * root )
+template < typename LookupKey, typename Compare >
+typename BST< KeyType, ValueType >::BTNode * & BST< KeyType, ValueType >::find_slot( BTNode * & root, const LookupKey & key, const Compare & less, size_t & depth )
 {
-    if(root == nullptr)
+    BTNode ** slot = &root;
+    depth = 1;
+
+    while(*slot != nullptr)
     {
-        return nullptr;
-    }
+        BTNode * node = *slot;
+        BST_PREFETCH(node->left);
+        BST_PREFETCH(node->right);
 
-    BTNode * new_node = new BTNode(root->key, root->data);
+        bool go_left = less(node->key, key);
+        if(!go_left && !less(key, node->key))
+        {
+            break;
+        }
+        slot = go_left ? &node->left : &node->right;
+        depth++;
+    }
 
-    new_node->left = clone(root->left);
-    new_node->right = clone(root->right);
+    return *slot;
+}
 
-    return new_node;
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::clear( BTNode * & root )
+{
+    forget_all_cached();
+    m_finger.clear();
+    abandon_rebalance();
+    free_subtree(root);
+    root = nullptr;
+    m_n_nodes = 0;
+    m_max_depth = 0;
+    release_blocks();
 }
 
 template < typename KeyType, typename ValueType >
-template < typename UnaryFunction >
-void BST< KeyType, ValueType >::preorder( const BTNode * root, const UnaryFunction & visit ) const 
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::create_node( const KeyType & key, const ValueType & value )
 {
-    if(root == nullptr)
+    void * slot;
+
+    if(m_free_slots != nullptr)
     {
-        return;
+        slot = m_free_slots;
+        m_free_slots = m_free_slots->next;
+    }
+    else
+    {
+        if(m_bump == m_bump_end)
+        {
+            // Grow geometrically, so that the number of blocks stays logarithmic.
+            m_bump = allocate_block(std::max< size_t >(16, m_capacity));
+            m_bump_end = m_bump + m_blocks.back().second;
+        }
+        slot = m_bump++;
     }
-    
-    visit(root->data);
 
-    preorder(root->left, visit);
-    preorder(root->right, visit);
+    try
+    {
+        return ::new ( slot ) BTNode(key, value, nullptr, nullptr);
+    }
+    catch(...)
+    {
+        m_free_slots = ::new ( slot ) FreeSlot{ m_free_slots };
+        throw;
+    }
 }
 
 template < typename KeyType, typename ValueType >
-template < typename UnaryFunction >
-void BST< KeyType, ValueType >::postorder( const BTNode * root, const UnaryFunction & visit ) const 
+void BST< KeyType, ValueType >::destroy_node( BTNode * node )
 {
-    if(root == nullptr)
-    {
-        return;
-    }
+    node->~BTNode();
+    m_free_slots = ::new ( static_cast< void * >( node ) ) FreeSlot{ m_free_slots };
+}
 
-    postorder(root->left, visit);
-    postorder(root->right, visit);
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::allocate_block( size_t n )
+{
+    BTNode * block = std::allocator< BTNode >().allocate(n);
+    m_blocks.push_back(block_type(block, n));
+    m_capacity += n;
 
-    visit(root->data);
+    return block;
 }
 
 template < typename KeyType, typename ValueType >
-template < typename UnaryFunction >
-void BST< KeyType, ValueType >::inorder( const BTNode * root, const UnaryFunction & visit ) const 
+void BST< KeyType, ValueType >::release_blocks( void )
 {
-    if(root == nullptr)
+    for(const auto & block : m_blocks)
     {
-        return;
+        std::allocator< BTNode >().deallocate(block.first, block.second);
     }
 
-    inorder(root->left, visit);
-
-    visit(root->data);
-
-    inorder(root->right, visit);
+    m_blocks.clear();
+    m_capacity = 0;
+    m_free_slots = nullptr;
+    m_bump = nullptr;
+    m_bump_end = nullptr;
 }
 
 template < typename KeyType, typename ValueType >
-const typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::get_smallest_leaf( const BTNode * root ) const 
+void BST< KeyType, ValueType >::veb_order( BTNode * root, size_t levels, std::vector< BTNode * > & order )
 {
-    if(root == nullptr)
-    {   
-        return nullptr;
+    if(root == nullptr || levels == 0)
+    {
+        return;
     }
 
-    if(root->left == nullptr)
+    if(levels == 1)
     {
-        return root;
+        order.push_back(root);
+        return;
     }
-    else
+
+    size_t top_height = levels / 2;
+    size_t bottom_height = levels - top_height;
+
+    // (1) The top half of the tree.
+    veb_order(root, top_height, order);
+
+    // (2) The subtrees hanging from the top half, from left to right.
+    std::vector< BTNode * > bottoms;
+    std::stack< std::pair< BTNode *, size_t >, std::vector< std::pair< BTNode *, size_t > > > s;
+    s.push(std::make_pair(root, 0));
+    while(!s.empty())
     {
-        return get_smallest_leaf(root->left);
+        auto visited = s.top(); s.pop();
+        if(visited.second == top_height)
+        {
+            bottoms.push_back(visited.first);
+            continue;
+        }
+        if(visited.first->right != nullptr)
+        {
+            s.push(std::make_pair(visited.first->right, visited.second + 1));
+        }
+        if(visited.first->left != nullptr)
+        {
+            s.push(std::make_pair(visited.first->left, visited.second + 1));
+        }
+    }
+
+    for(BTNode * bottom : bottoms)
+    {
+        veb_order(bottom, bottom_height, order);
     }
 }
+
 template < typename KeyType, typename ValueType >
-BST< KeyType, ValueType >::BST( const BST & other ):m_key_less(other.m_key_less) 
+void BST< KeyType, ValueType >::relocate_node( BTNode * where, BTNode & node, std::true_type )
 {
-    *this = other;
+    ::new ( static_cast< void * >( where ) ) BTNode(std::move(node.key), std::move(node.data), node.left, node.right);
 }
 
 template < typename KeyType, typename ValueType >
-BST< KeyType, ValueType >::~BST()
-{ 
-    delete m_root;
+void BST< KeyType, ValueType >::relocate_node( BTNode * where, BTNode & node, std::false_type )
+{
+    ::new ( static_cast< void * >( where ) ) BTNode(node.key, node.data, node.left, node.right);
 }
 
 template < typename KeyType, typename ValueType >
-template < typename InputItr >
-BST< KeyType, ValueType >::BST( InputItr first, InputItr last, const KeyTypeLess & comp ): m_key_less(comp) 
+size_t BST< KeyType, ValueType >::height( const BTNode * root )
 {
-    for(auto it=first; it!= last; it++)
-    {  
-        (*this).insert(m_root, (*it).first, (*it).second);
+    size_t levels = 0;
+    std::stack< std::pair< const BTNode *, size_t >, std::vector< std::pair< const BTNode *, size_t > > > s;
+
+    if(root != nullptr)
+    {
+        s.push(std::make_pair(root, 1));
     }
-}
 
-template < typename KeyType, typename ValueType >
-BST< KeyType, ValueType >::BST( std::initializer_list< BST< KeyType, ValueType >::node_content_type > init , const KeyTypeLess & comp ):m_key_less(comp)
-{
-    *this = init;
+    while(!s.empty())
+    {
+        auto visited = s.top(); s.pop();
+        levels = std::max(levels, visited.second);
+        if(visited.first->left != nullptr)
+        {
+            s.push(std::make_pair(visited.first->left, visited.second + 1));
+        }
+        if(visited.first->right != nullptr)
+        {
+            s.push(std::make_pair(visited.first->right, visited.second + 1));
+        }
+    }
+
+    return levels;
 }
 
 template < typename KeyType, typename ValueType >
-BST< KeyType, ValueType > & BST< KeyType, ValueType >::operator=( const BST< KeyType, ValueType > & rhs )
+size_t BST< KeyType, ValueType >::balanced_height( size_t n_nodes )
 {
+    size_t levels = 0;
+    while(n_nodes > 0)
+    {
+        levels++;
+        n_nodes >>= 1;
+    }
 
-    delete m_root;
-    m_root = clone(rhs.m_root);
-    m_n_nodes = rhs.m_n_nodes;
-    m_key_less = rhs.m_key_less;
-
-    return *this;
-
+    return levels;
 }
 
 template < typename KeyType, typename ValueType >
-BST< KeyType, ValueType > & BST< KeyType, ValueType >::operator=( std::initializer_list< BST< KeyType, ValueType >::node_content_type > ilist )
+size_t BST< KeyType, ValueType >::count_nodes( const BTNode * root )
 {
-    for(const auto & element: ilist)
+    size_t n_nodes = 0;
+    std::vector< const BTNode * > s;
+
+    if(root != nullptr)
     {
-        (*this).insert(element.first, element.second);
+        s.push_back(root);
     }
 
-    return *this;
+    while(!s.empty())
+    {
+        const BTNode * node = s.back(); s.pop_back();
+        n_nodes++;
+        if(node->left != nullptr)
+        {
+            s.push_back(node->left);
+        }
+        if(node->right != nullptr)
+        {
+            s.push_back(node->right);
+        }
+    }
+
+    return n_nodes;
 }
 
 template < typename KeyType, typename ValueType >
-const ValueType & BST< KeyType, ValueType >::find_min( void ) const
+size_t BST< KeyType, ValueType >::height_limit( size_t n_nodes ) const
 {
-    return get_smallest_leaf(m_root)->data;
+    size_t limit = static_cast< size_t >( m_max_height_factor * std::log2(n_nodes + 1.0) );
+    return std::max(limit, balanced_height(n_nodes) + 1);
 }
 
 template < typename KeyType, typename ValueType >
-const ValueType & BST< KeyType, ValueType >::find_max( void ) const
+void BST< KeyType, ValueType >::note_insertion( const BTNode * node, size_t depth )
 {
-    if(m_root != nullptr)
+    if(m_max_height_factor <= 0)
     {
-        BTNode * temp = m_root;
-        while(temp->right != nullptr)
+        m_max_depth = std::max(m_max_depth, depth); // In case incremental rebalancing is turned on later.
+        return;
+    }
+
+    // Nodes too deep are taken care of below, or by the rebalance in progress. Only removals,
+    // by lowering the limit, may then set off a rebalance of the whole tree.
+    size_t limit = height_limit(m_n_nodes);
+    m_max_depth = std::max(m_max_depth, std::min(depth, limit));
+
+    if(m_rebalance.phase == RebalanceJob::Phase::IDLE && depth > limit)
+    {
+        // Find the path down to the new node. Equivalent keys of a MultiBST may have been
+        // rotated to either side of one another, in which case the node may not be found.
+        std::vector< BTNode ** > path; // The links to the nodes of levels 1, 2, ...
+        BTNode ** link = &m_root;
+        while(*link != nullptr && *link != node)
         {
-            temp = temp->right;
+            path.push_back(link);
+            link = m_key_less((*link)->key, node->key) ? &(*link)->left : &(*link)->right;
         }
+        path.push_back(link);
 
-        return temp->data;
-    }
-    else
-    {
-        throw std::runtime_error("find_max: called upon an empty tree");
+        // Climb back, counting the nodes below, up to the first subtree that is too tall
+        // for its own size. The whole tree is, so the search stops at the root at the latest.
+        size_t n_below = 1;
+        for(size_t level = path.size() - 1; *link == node && level > 0; --level)
+        {
+            const BTNode * parent = *path[level - 1];
+            const BTNode * child = *path[level];
+            n_below += 1 + count_nodes(parent->left == child ? parent->right : parent->left);
+            if(path.size() - level + 1 > height_limit(n_below))
+            {
+                BTNode * owner = level > 1 ? *path[level - 2] : nullptr;
+                start_rebalance(owner, owner != nullptr && path[level - 1] == &owner->left, n_below);
+                break;
+            }
+        }
     }
+
+    rebalance_some();
 }
 
 template < typename KeyType, typename ValueType >
-bool BST< KeyType, ValueType >::contains( const KeyType & key ) const
+void BST< KeyType, ValueType >::rebalance_some( void )
 {
-    return contains(m_root, key);
+    if(m_max_height_factor <= 0)
+    {
+        return;
+    }
+
+    if(m_rebalance.phase == RebalanceJob::Phase::IDLE)
+    {
+        if(m_max_depth <= height_limit(m_n_nodes))
+        {
+            return;
+        }
+        start_rebalance(nullptr, false, m_n_nodes);
+    }
+
+    for(size_t step = 0; step < m_rebalance.budget && rebalance_step(); ++step)
+    {
+        /* empty */
+    }
 }
 
 template < typename KeyType, typename ValueType >
-bool BST< KeyType, ValueType >::retrieve( const KeyType & key, ValueType & value ) const
+void BST< KeyType, ValueType >::start_rebalance( BTNode * owner, bool owner_left, size_t n_nodes )
 {
-    return retrieve(m_root, key, value);
+    // A job takes at most about 3 steps per node: be done within `rebalance_window` operations.
+    size_t budget = std::max(m_rebalance_steps, 3 * n_nodes / rebalance_window + 1);
+    m_rebalance = RebalanceJob{ RebalanceJob::Phase::VINE, owner, owner_left, budget, nullptr, 0, 0, 0 };
 }
 
 template < typename KeyType, typename ValueType >
-template < typename UnaryFunction >
-void BST< KeyType, ValueType >::preorder( const UnaryFunction & visit ) const 
+typename BST< KeyType, ValueType >::BTNode ** BST< KeyType, ValueType >::rebalance_top( void )
 {
-    return preorder(m_root, visit);
+    BTNode * owner = m_rebalance.owner;
+    if(owner == nullptr)
+    {
+        return &m_root;
+    }
+
+    return m_rebalance.owner_left ? &owner->left : &owner->right;
 }
 
 template < typename KeyType, typename ValueType >
-template < typename UnaryFunction >
-void BST< KeyType, ValueType >::postorder( const UnaryFunction & visit ) const 
+void BST< KeyType, ValueType >::abandon_rebalance( void )
 {
-    return postorder(m_root, visit);
+    m_rebalance = RebalanceJob{ RebalanceJob::Phase::IDLE, nullptr, false, 0, nullptr, 0, 0, 0 };
 }
 
 template < typename KeyType, typename ValueType >
-template < typename UnaryFunction >
-void BST< KeyType, ValueType >::inorder( const UnaryFunction & visit ) const 
+bool BST< KeyType, ValueType >::rebalance_step( void )
 {
-    return inorder(m_root, visit);
+    RebalanceJob & job = m_rebalance;
+    BTNode ** link = job.anchor != nullptr ? &job.anchor->right : rebalance_top();
+
+    if(job.phase == RebalanceJob::Phase::VINE)
+    {
+        BTNode * rest = *link;
+        if(rest == nullptr)
+        {
+            // The vine is complete. The first pass folds the nodes that do not fit in
+            // the largest perfect tree, each next pass halves the vine that remains.
+            size_t perfect = 0;
+            while(2 * perfect + 1 <= job.vine_length)
+            {
+                perfect = 2 * perfect + 1;
+            }
+            job.phase = RebalanceJob::Phase::COMPRESS;
+            job.anchor = nullptr;
+            job.pass_left = job.vine_length - perfect;
+            job.pass_size = perfect;
+        }
+        else if(rest->left != nullptr)
+        {
+            // Rotate right, moving the left child up into the vine.
+            BTNode * child = rest->left;
+            rest->left = child->right;
+            child->right = rest;
+            *link = child;
+            m_finger.clear();
+        }
+        else
+        {
+            job.anchor = rest;
+            job.vine_length++;
+        }
+
+        return true;
+    }
+
+    if(job.phase == RebalanceJob::Phase::COMPRESS)
+    {
+        if(job.pass_left == 0)
+        {
+            if(job.pass_size <= 1)
+            {
+                if(job.owner == nullptr)
+                {
+                    m_max_depth = balanced_height(m_n_nodes);
+                }
+                abandon_rebalance(); // Done.
+                return false;
+            }
+            job.pass_size /= 2;
+            job.pass_left = job.pass_size;
+            job.anchor = nullptr;
+            return true;
+        }
+
+        BTNode * child = *link;
+        if(child == nullptr || child->right == nullptr)
+        {
+            job.pass_left = 0; // Insertions and removals changed the vine: cut the pass short.
+            return true;
+        }
+
+        // Rotate left, folding the child under the next node of the vine.
+        BTNode * next = child->right;
+        child->right = next->left;
+        next->left = child;
+        *link = next;
+        m_finger.clear();
+        job.anchor = next;
+        job.pass_left--;
+
+        return true;
+    }
+
+    return false;
 }
 
 template < typename KeyType, typename ValueType >
-void BST< KeyType, ValueType >::clear( void )
+size_t BST< KeyType, ValueType >::free_subtree( BTNode * root )
 {
-    return clear(m_root);
-}
+    size_t n_freed = 0;
 
-template < typename KeyType, typename ValueType >
+    // Rotate left children up so that every node is freed once its left subtree is gone.
+    while(root != nullptr)
+    {
+        if(root->left != nullptr)
+        {
+            BTNode * child = root->left;
+            root->left = child->right;
+            child->right = root;
+            root = child;
+        }
+        else
+        {
+            BTNode * next = root->right;
+            destroy_node(root);
+            root = next;
+            n_freed++;
+        }
+    }
+
+    return n_freed;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename KeyPredicate >
+void BST< KeyType, ValueType >::split( BTNode * root, const KeyPredicate & goes_first, BTNode * & first, BTNode * & second )
+{
+    BTNode ** first_slot = &first;
+    BTNode ** second_slot = &second;
+
+    while(root != nullptr)
+    {
+        if(goes_first(root->key))
+        {
+            // The root and its right subtree (smaller keys) belong to the first tree.
+            *first_slot = root;
+            first_slot = &root->left;
+            root = root->left;
+        }
+        else
+        {
+            // The root and its left subtree (larger keys) belong to the second tree.
+            *second_slot = root;
+            second_slot = &root->right;
+            root = root->right;
+        }
+    }
+
+    *first_slot = nullptr;
+    *second_slot = nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::join( BTNode * first, BTNode * second )
+{
+    if(first == nullptr)
+    {
+        return second;
+    }
+
+    // Detach the largest key of the first tree, and make it the root of both trees.
+    BTNode ** link = &first;
+    while((*link)->left != nullptr)
+    {
+        link = &(*link)->left;
+    }
+    BTNode * largest = *link;
+    *link = largest->right;
+    largest->left = second;
+    largest->right = first;
+
+    return largest;
+}
+
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::clone( const BTNode * root, size_t n_nodes, std::vector< BTNode * > & recycled )
+{
+    size_t n_recycled = 0;
+    if(n_nodes > recycled.size())
+    {
+        reserve_contiguous(n_nodes - recycled.size());
+    }
+
+    BTNode * copy = nullptr;
+    try
+    {
+        copy_preorder(root, copy, [&]( const BTNode & source ) -> BTNode *
+        {
+            if(n_recycled < recycled.size())
+            {
+                BTNode * node = recycled[n_recycled];
+                node->key = source.key;
+                node->data = source.data;
+                node->left = nullptr;
+                node->right = nullptr;
+                n_recycled++;
+                return node;
+            }
+
+            BTNode * node = ::new ( static_cast< void * >( m_bump ) ) BTNode(source.key, source.data);
+            m_bump++;
+            return node;
+        });
+    }
+    catch(...)
+    {
+        free_subtree(copy);
+        for(size_t i = n_recycled; i < recycled.size(); ++i)
+        {
+            destroy_node(recycled[i]);
+        }
+        recycled.clear();
+        throw;
+    }
+
+    for(size_t i = n_recycled; i < recycled.size(); ++i)
+    {
+        destroy_node(recycled[i]);
+    }
+    recycled.clear();
+
+    return copy;
+}
+
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::clone_block( const BTNode * root, block_type & block )
+{
+    size_t n_nodes = 0;
+    std::vector< const BTNode * > s(1, root);
+    while(!s.empty())
+    {
+        const BTNode * node = s.back(); s.pop_back();
+        n_nodes++;
+        if(node->left != nullptr)
+        {
+            s.push_back(node->left);
+        }
+        if(node->right != nullptr)
+        {
+            s.push_back(node->right);
+        }
+    }
+
+    block = block_type(std::allocator< BTNode >().allocate(n_nodes), n_nodes);
+    size_t n_built = 0;
+
+    BTNode * copy = nullptr;
+    try
+    {
+        copy_preorder(root, copy, [&]( const BTNode & source ) -> BTNode *
+        {
+            BTNode * node = ::new ( static_cast< void * >( block.first + n_built ) ) BTNode(source.key, source.data);
+            n_built++;
+            return node;
+        });
+    }
+    catch(...)
+    {
+        for(size_t i = 0; i < n_built; ++i)
+        {
+            block.first[i].~BTNode();
+        }
+        std::allocator< BTNode >().deallocate(block.first, block.second);
+        throw;
+    }
+
+    return copy;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodeFactory >
+void BST< KeyType, ValueType >::copy_preorder( const BTNode * root, BTNode * & copy, const NodeFactory & make_node )
+{
+    copy = nullptr;
+    // The pending right subtrees, with the links their copies go to.
+    std::vector< std::pair< const BTNode *, BTNode ** > > s;
+    BTNode ** link = &copy;
+
+    while(true)
+    {
+        // Copy down the left spine, leaving the right subtrees for later.
+        while(root != nullptr)
+        {
+            BTNode * node = make_node(*root);
+            *link = node;
+            if(root->right != nullptr)
+            {
+                s.push_back(std::make_pair(root->right, &node->right));
+            }
+            link = &node->left;
+            root = root->left;
+        }
+
+        if(s.empty())
+        {
+            return;
+        }
+
+        root = s.back().first;
+        link = s.back().second;
+        s.pop_back();
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::reserve_contiguous( size_t n )
+{
+    if(size_t(m_bump_end - m_bump) >= n)
+    {
+        return;
+    }
+
+    while(m_bump != m_bump_end)
+    {
+        m_free_slots = ::new ( static_cast< void * >( m_bump++ ) ) FreeSlot{ m_free_slots };
+    }
+
+    m_bump = allocate_block(n);
+    m_bump_end = m_bump + n;
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::copy_settings( const BST & other )
+{
+    m_key_less = other.m_key_less;
+    m_access_policy = other.m_access_policy;
+    m_max_height_factor = other.m_max_height_factor;
+    m_rebalance_steps = other.m_rebalance_steps;
+    m_max_depth = other.m_max_depth; // Copies have the same shape.
+    if(other.m_cache.empty())
+    {
+        disable_lookup_cache();
+    }
+    else
+    {
+        enable_lookup_cache(other.m_cache.size(), other.m_cache_hash);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::bulk_build( std::vector< std::pair< KeyType, ValueType > > & pairs )
+{
+    unsigned n_threads = 1;
+    if(pairs.size() >= parallel_build_threshold)
+    {
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // (1) Sort the pairs, and keep only the first of those with equivalent keys.
+    parallel_sort(pairs, n_threads);
+    auto equivalent = [this]( const std::pair< KeyType, ValueType > & a, const std::pair< KeyType, ValueType > & b )
+    {
+        return !m_key_less(a.first, b.first) && !m_key_less(b.first, a.first);
+    };
+    pairs.erase(std::unique(pairs.begin(), pairs.end(), equivalent), pairs.end());
+    if(pairs.empty())
+    {
+        return;
+    }
+
+    // (2) Build the nodes, in key order, in a single block. Each thread builds a slice.
+    size_t n_nodes = pairs.size();
+    m_blocks.reserve(m_blocks.size() + 1);
+    BTNode * nodes = std::allocator< BTNode >().allocate(n_nodes);
+    std::vector< size_t > n_built(n_threads, 0);
+    try
+    {
+        run_in_parallel(n_threads, [&]( size_t slice )
+        {
+            size_t first = n_nodes * slice / n_threads;
+            size_t last = n_nodes * ( slice + 1 ) / n_threads;
+            for(size_t i = first; i < last; ++i)
+            {
+                ::new ( static_cast< void * >( nodes + i ) ) BTNode(pairs[i].first, pairs[i].second);
+                n_built[slice]++;
+            }
+        });
+    }
+    catch(...)
+    {
+        for(size_t slice = 0; slice < n_threads; ++slice)
+        {
+            size_t first = n_nodes * slice / n_threads;
+            for(size_t i = first; i < first + n_built[slice]; ++i)
+            {
+                nodes[i].~BTNode();
+            }
+        }
+        std::allocator< BTNode >().deallocate(nodes, n_nodes);
+        throw;
+    }
+    m_blocks.push_back(block_type(nodes, n_nodes));
+    m_capacity += n_nodes;
+
+    // (3) Link them up.
+    unsigned spawn_depth = 0;
+    while((1u << spawn_depth) < n_threads)
+    {
+        spawn_depth++;
+    }
+    m_root = link_balanced(nodes, n_nodes, spawn_depth);
+    m_n_nodes = n_nodes;
+    m_max_depth = balanced_height(n_nodes);
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::parallel_sort( std::vector< std::pair< KeyType, ValueType > > & pairs, unsigned n_threads ) const
+{
+    auto before = [this]( const std::pair< KeyType, ValueType > & a, const std::pair< KeyType, ValueType > & b )
+    {
+        return m_key_less(a.first, b.first);
+    };
+
+    // (1) Sort runs of about the same size.
+    size_t n_runs = std::max(1u, n_threads);
+    std::vector< size_t > bounds(n_runs + 1);
+    for(size_t run = 0; run <= n_runs; ++run)
+    {
+        bounds[run] = pairs.size() * run / n_runs;
+    }
+    run_in_parallel(n_runs, [&]( size_t run )
+    {
+        std::stable_sort(pairs.begin() + bounds[run], pairs.begin() + bounds[run + 1], before);
+    });
+
+    // (2) Merge neighbouring runs two by two, until a single run is left.
+    for(size_t width = 1; width < n_runs; width *= 2)
+    {
+        size_t n_merges = ( n_runs + 2 * width - 1 ) / ( 2 * width );
+        run_in_parallel(n_merges, [&]( size_t merge )
+        {
+            size_t first = 2 * width * merge;
+            size_t middle = std::min(first + width, n_runs);
+            size_t last = std::min(first + 2 * width, n_runs);
+            std::inplace_merge(pairs.begin() + bounds[first], pairs.begin() + bounds[middle],
+                               pairs.begin() + bounds[last], before);
+        });
+    }
+}
+
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::link_balanced( BTNode * nodes, size_t n_nodes, unsigned spawn_depth )
+{
+    if(n_nodes == 0)
+    {
+        return nullptr;
+    }
+
+    // The keys before the middle one go to its right subtree, the keys after it to its left subtree.
+    size_t middle = n_nodes / 2;
+    BTNode * root = nodes + middle;
+    auto link_half = [&]( size_t half )
+    {
+        unsigned depth = spawn_depth > 0 ? spawn_depth - 1 : 0;
+        if(half == 0)
+        {
+            root->right = link_balanced(nodes, middle, depth);
+        }
+        else
+        {
+            root->left = link_balanced(nodes + middle + 1, n_nodes - middle - 1, depth);
+        }
+    };
+
+    if(spawn_depth > 0)
+    {
+        run_in_parallel(2, link_half);
+    }
+    else
+    {
+        link_half(0);
+        link_half(1);
+    }
+
+    return root;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Task >
+void BST< KeyType, ValueType >::run_in_parallel( size_t n_tasks, const Task & task )
+{
+    std::vector< std::exception_ptr > errors(n_tasks);
+    auto run = [&]( size_t i )
+    {
+        try
+        {
+            task(i);
+        }
+        catch(...)
+        {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    std::vector< std::thread > workers;
+    workers.reserve(n_tasks);
+    for(size_t i = 1; i < n_tasks; ++i)
+    {
+        try
+        {
+            workers.emplace_back(run, i);
+        }
+        catch(const std::system_error &)
+        {
+            run(i); // No thread to spare: run it here.
+        }
+    }
+    if(n_tasks > 0)
+    {
+        run(0);
+    }
+    for(auto & worker : workers)
+    {
+        worker.join();
+    }
+
+    for(const auto & error : errors)
+    {
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool BST< KeyType, ValueType >::preorder( NodePointer root, Function & visit )
+{
+    if(root == nullptr)
+    {
+        return true;
+    }
+
+    std::stack< NodePointer, std::vector< NodePointer > > s;
+    s.push(root);
+
+    while(!s.empty())
+    {
+        NodePointer node = s.top(); s.pop();
+
+        if(!bst_detail::keep_visiting(visit, node->key, node->data))
+        {
+            return false;
+        }
+
+        // Right goes first so that the left subtree is visited first.
+        if(node->right != nullptr)
+        {
+            s.push(node->right);
+        }
+        if(node->left != nullptr)
+        {
+            s.push(node->left);
+        }
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool BST< KeyType, ValueType >::postorder( NodePointer root, Function & visit )
+{
+    std::stack< NodePointer, std::vector< NodePointer > > s;
+    NodePointer last_visited = nullptr;
+
+    while(root != nullptr || !s.empty())
+    {
+        if(root != nullptr)
+        {
+            s.push(root);
+            root = root->left;
+            continue;
+        }
+
+        NodePointer top = s.top();
+        if(top->right != nullptr && top->right != last_visited)
+        {
+            // The right subtree has not been visited yet.
+            root = top->right;
+        }
+        else
+        {
+            if(!bst_detail::keep_visiting(visit, top->key, top->data))
+            {
+                return false;
+            }
+            last_visited = top;
+            s.pop();
+        }
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool BST< KeyType, ValueType >::inorder( NodePointer root, Function & visit )
+{
+    std::stack< NodePointer, std::vector< NodePointer > > s;
+
+    while(root != nullptr || !s.empty())
+    {
+        while(root != nullptr)
+        {
+            s.push(root);
+            root = root->left;
+        }
+
+        root = s.top(); s.pop();
+
+        if(!bst_detail::keep_visiting(visit, root->key, root->data))
+        {
+            return false;
+        }
+
+        root = root->right;
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool BST< KeyType, ValueType >::levelorder( NodePointer root, Function & visit )
+{
+    if(root == nullptr)
+    {
+        return true;
+    }
+
+    std::queue< NodePointer > q;
+    q.push(root);
+
+    while(!q.empty())
+    {
+        NodePointer node = q.front(); q.pop();
+
+        if(!bst_detail::keep_visiting(visit, node->key, node->data))
+        {
+            return false;
+        }
+
+        if(node->left != nullptr)
+        {
+            q.push(node->left);
+        }
+        if(node->right != nullptr)
+        {
+            q.push(node->right);
+        }
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+void BST< KeyType, ValueType >::for_each_in_range( NodePointer root, const KeyType & lo, const KeyType & hi, Function & visit ) const 
+{
+    std::stack< NodePointer, std::vector< NodePointer > > s;
+
+    while(root != nullptr || !s.empty())
+    {
+        // The left subtree holds larger keys: worth exploring only if root->key <= hi.
+        while(root != nullptr)
+        {
+            s.push(root);
+            root = !m_key_less(hi, root->key) ? root->left : nullptr;
+        }
+
+        root = s.top(); s.pop();
+
+        bool not_before_lo = !m_key_less(root->key, lo);
+        if(not_before_lo && !m_key_less(hi, root->key))
+        {
+            if(!bst_detail::keep_visiting(visit, root->key, root->data))
+            {
+                return;
+            }
+        }
+
+        // The right subtree holds smaller keys: worth exploring only if root->key >= lo.
+        root = not_before_lo ? root->right : nullptr;
+    }
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+void BST< KeyType, ValueType >::inorder_chunks( NodePointer root, Function & visit )
+{
+    typedef decltype( &root->data ) ValuePointer; // Carries the constness of the traversal.
+    ValuePointer chunk[chunk_size];
+    size_t n_gathered = 0;
+
+    auto gather = [&]( typename std::remove_pointer< ValuePointer >::type & value ) -> bool
+    {
+        chunk[n_gathered++] = &value;
+        if(n_gathered < chunk_size)
+        {
+            return true;
+        }
+        n_gathered = 0;
+        return bst_detail::keep_visiting_chunk(visit, chunk, chunk_size);
+    };
+
+    if(inorder(root, gather) && n_gathered > 0)
+    {
+        bst_detail::keep_visiting_chunk(visit, chunk, n_gathered);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+const typename BST< KeyType, ValueType >::BTNode * BST< KeyType, ValueType >::get_smallest_leaf( const BTNode * root ) const 
+{
+    if(root == nullptr)
+    {   
+        return nullptr;
+    }
+
+    if(root->left == nullptr)
+    {
+        return root;
+    }
+    else
+    {
+        return get_smallest_leaf(root->left);
+    }
+}
+template < typename KeyType, typename ValueType >
+BST< KeyType, ValueType >::BST( const BST & other )
+    : m_root( nullptr )
+    , m_n_nodes( 0 )
+    , m_key_less( other.m_key_less )
+    , m_capacity( 0 )
+    , m_access_policy( AccessPolicy::STATIC )
+    , m_cache_shift( 0 )
+    , m_cache_hits( 0 )
+    , m_cache_misses( 0 )
+    , m_free_slots( nullptr )
+    , m_bump( nullptr )
+    , m_bump_end( nullptr )
+    , m_rebalance( RebalanceJob{ RebalanceJob::Phase::IDLE, nullptr, false, 0, nullptr, 0, 0, 0 } )
+    , m_max_height_factor( 0 )
+    , m_rebalance_steps( 0 )
+    , m_max_depth( 0 )
+{
+    *this = other;
+}
+
+template < typename KeyType, typename ValueType >
+BST< KeyType, ValueType >::~BST()
+{ 
+    free_subtree(m_root);
+    release_blocks();
+}
+
+template < typename KeyType, typename ValueType >
+template < typename InputItr >
+BST< KeyType, ValueType >::BST( InputItr first, InputItr last, const KeyTypeLess & comp )
+    : m_root( nullptr )
+    , m_n_nodes( 0 )
+    , m_key_less( comp )
+    , m_capacity( 0 )
+    , m_access_policy( AccessPolicy::STATIC )
+    , m_cache_shift( 0 )
+    , m_cache_hits( 0 )
+    , m_cache_misses( 0 )
+    , m_free_slots( nullptr )
+    , m_bump( nullptr )
+    , m_bump_end( nullptr )
+    , m_rebalance( RebalanceJob{ RebalanceJob::Phase::IDLE, nullptr, false, 0, nullptr, 0, 0, 0 } )
+    , m_max_height_factor( 0 )
+    , m_rebalance_steps( 0 )
+    , m_max_depth( 0 )
+{
+    std::vector< node_content_type > pairs;
+    for(auto it=first; it!= last; it++)
+    {  
+        pairs.push_back(node_content_type((*it).first, (*it).second));
+    }
+    bulk_build(pairs);
+}
+
+template < typename KeyType, typename ValueType >
+BST< KeyType, ValueType >::BST( std::initializer_list< BST< KeyType, ValueType >::node_content_type > init , const KeyTypeLess & comp )
+    : m_root( nullptr )
+    , m_n_nodes( 0 )
+    , m_key_less( comp )
+    , m_capacity( 0 )
+    , m_access_policy( AccessPolicy::STATIC )
+    , m_cache_shift( 0 )
+    , m_cache_hits( 0 )
+    , m_cache_misses( 0 )
+    , m_free_slots( nullptr )
+    , m_bump( nullptr )
+    , m_bump_end( nullptr )
+    , m_rebalance( RebalanceJob{ RebalanceJob::Phase::IDLE, nullptr, false, 0, nullptr, 0, 0, 0 } )
+    , m_max_height_factor( 0 )
+    , m_rebalance_steps( 0 )
+    , m_max_depth( 0 )
+{
+    std::vector< node_content_type > pairs(init);
+    bulk_build(pairs);
+}
+
+template < typename KeyType, typename ValueType >
+BST< KeyType, ValueType > & BST< KeyType, ValueType >::operator=( const BST< KeyType, ValueType > & rhs )
+{
+    if(this == &rhs)
+    {
+        return *this;
+    }
+
+    // Detach our nodes, so that the copy may reuse them. They are listed in preorder,
+    // which is also the order they are reused in and, after a copy, their order in memory.
+    forget_all_cached();
+    m_finger.clear();
+    abandon_rebalance();
+    std::vector< BTNode * > recycled;
+    recycled.reserve(m_n_nodes);
+    std::vector< BTNode * > s;
+    if(m_root != nullptr)
+    {
+        s.push_back(m_root);
+    }
+    while(!s.empty())
+    {
+        BTNode * node = s.back(); s.pop_back();
+        recycled.push_back(node);
+        if(node->right != nullptr)
+        {
+            s.push_back(node->right);
+        }
+        if(node->left != nullptr)
+        {
+            s.push_back(node->left);
+        }
+    }
+    m_root = nullptr;
+    m_n_nodes = 0;
+
+    copy_settings(rhs);
+    m_root = clone(rhs.m_root, rhs.m_n_nodes, recycled);
+    m_n_nodes = rhs.m_n_nodes;
+
+    return *this;
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::assign( const BST & rhs, unsigned n_threads )
+{
+    if(n_threads <= 1 || rhs.m_n_nodes < parallel_clone_threshold)
+    {
+        *this = rhs;
+        return;
+    }
+    if(this == &rhs)
+    {
+        return;
+    }
+
+    clear(m_root);
+    copy_settings(rhs);
+
+    // (1) Copy the top of the tree, breadth-first, until there are enough subtrees left to share out.
+    struct CloneTask {
+        const BTNode * source; //!< The subtree to copy.
+        BTNode ** link; //!< Where its copy goes.
+        BTNode * copy; //!< The copy.
+        block_type block; //!< The storage of the copy.
+        std::exception_ptr error; //!< What went wrong, if anything.
+    };
+    std::deque< CloneTask > tasks;
+    tasks.push_back(CloneTask{ rhs.m_root, &m_root, nullptr, block_type(nullptr, 0), nullptr });
+    try
+    {
+        while(!tasks.empty() && tasks.size() < n_threads)
+        {
+            CloneTask top = tasks.front();
+            tasks.pop_front();
+
+            BTNode * node = create_node(top.source->key, top.source->data);
+            *top.link = node;
+            m_n_nodes++;
+
+            if(top.source->left != nullptr)
+            {
+                tasks.push_back(CloneTask{ top.source->left, &node->left, nullptr, block_type(nullptr, 0), nullptr });
+            }
+            if(top.source->right != nullptr)
+            {
+                tasks.push_back(CloneTask{ top.source->right, &node->right, nullptr, block_type(nullptr, 0), nullptr });
+            }
+        }
+
+        // Room for the blocks of the copies, so that taking them over in (3) cannot fail.
+        m_blocks.reserve(m_blocks.size() + tasks.size());
+    }
+    catch(...)
+    {
+        clear(m_root);
+        throw;
+    }
+
+    // (2) Copy the remaining subtrees at the same time.
+    run_in_parallel(tasks.size(), [&]( size_t i )
+    {
+        try
+        {
+            tasks[i].copy = clone_block(tasks[i].source, tasks[i].block);
+        }
+        catch(...)
+        {
+            tasks[i].error = std::current_exception();
+        }
+    });
+
+    // (3) Hang the copies under the top of the tree, and take ownership of their blocks.
+    std::exception_ptr error;
+    for(auto & task : tasks)
+    {
+        if(task.error)
+        {
+            error = task.error;
+            continue;
+        }
+        *task.link = task.copy;
+        m_blocks.push_back(task.block);
+        m_capacity += task.block.second;
+        m_n_nodes += task.block.second;
+    }
+
+    if(error)
+    {
+        clear(m_root);
+        std::rethrow_exception(error);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+BST< KeyType, ValueType > & BST< KeyType, ValueType >::operator=( std::initializer_list< BST< KeyType, ValueType >::node_content_type > ilist )
+{
+    std::vector< node_content_type > pairs(ilist);
+    clear(m_root);
+    bulk_build(pairs);
+
+    return *this;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType & BST< KeyType, ValueType >::find_min( void ) const
+{
+    return get_smallest_leaf(m_root)->data;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType & BST< KeyType, ValueType >::find_max( void ) const
+{
+    if(m_root != nullptr)
+    {
+        BTNode * temp = m_root;
+        while(temp->right != nullptr)
+        {
+            temp = temp->right;
+        }
+
+        return temp->data;
+    }
+    else
+    {
+        throw std::runtime_error("find_max: called upon an empty tree");
+    }
+}
+
+template < typename KeyType, typename ValueType >
+bool BST< KeyType, ValueType >::contains( const KeyType & key ) const
+{
+    return access(key) != nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+bool BST< KeyType, ValueType >::retrieve( const KeyType & key, ValueType & value ) const
+{
+    const BTNode * node = access(key);
+
+    if(node == nullptr)
+    {
+        return false;
+    }
+
+    value = node->data;
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType * BST< KeyType, ValueType >::find( const KeyType & key ) const
+{
+    const BTNode * node = access(key);
+    return node != nullptr ? &node->data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType * BST< KeyType, ValueType >::find( const KeyType & key )
+{
+    BTNode * node = access(key);
+    return node != nullptr ? &node->data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType & BST< KeyType, ValueType >::at( const KeyType & key ) const
+{
+    const ValueType * value = find(key);
+    if(value == nullptr)
+    {
+        throw std::out_of_range("at: key not found in the tree");
+    }
+
+    return *value;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType & BST< KeyType, ValueType >::at( const KeyType & key )
+{
+    ValueType * value = find(key);
+    if(value == nullptr)
+    {
+        throw std::out_of_range("at: key not found in the tree");
+    }
+
+    return *value;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType & BST< KeyType, ValueType >::operator[]( const KeyType & key )
+{
+    size_t depth = 0;
+    BTNode * & slot = find_slot(m_root, key, m_key_less, depth);
+
+    if(slot == nullptr)
+    {
+        slot = create_node(key, ValueType());
+        m_n_nodes++;
+        BTNode * node = slot; // Rebalancing may change the link, not the node.
+        note_insertion(node, depth);
+        return node->data;
+    }
+
+    return slot->data;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType & BST< KeyType, ValueType >::get_or_insert( const KeyType & key, const ValueType & value )
+{
+    size_t depth = 0;
+    BTNode * & slot = find_slot(m_root, key, m_key_less, depth);
+
+    if(slot == nullptr)
+    {
+        slot = create_node(key, value);
+        m_n_nodes++;
+        BTNode * node = slot; // Rebalancing may change the link, not the node.
+        note_insertion(node, depth);
+        return node->data;
+    }
+
+    return slot->data;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType * BST< KeyType, ValueType >::lower_bound( const KeyType & key ) const
+{
+    const BTNode * node = lower_bound_node(m_root, key, m_key_less);
+    return node != nullptr ? &node->data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+BST< KeyType, ValueType >::contains( const LookupKey & key, const Compare & comp ) const
+{
+    return find_node(m_root, key, comp) != nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+BST< KeyType, ValueType >::retrieve( const LookupKey & key, ValueType & value, const Compare & comp ) const
+{
+    const BTNode * node = find_node(m_root, key, comp);
+
+    if(node == nullptr)
+    {
+        return false;
+    }
+
+    value = node->data;
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+BST< KeyType, ValueType >::find( const LookupKey & key, const Compare & comp ) const
+{
+    const BTNode * node = find_node(m_root, key, comp);
+    return node != nullptr ? &node->data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, ValueType * >::type
+BST< KeyType, ValueType >::find( const LookupKey & key, const Compare & comp )
+{
+    BTNode * node = const_cast< BTNode * >( find_node(m_root, key, comp) );
+    return node != nullptr ? &node->data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+BST< KeyType, ValueType >::lower_bound( const LookupKey & key, const Compare & comp ) const
+{
+    const BTNode * node = lower_bound_node(m_root, key, comp);
+    return node != nullptr ? &node->data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value >::type
+BST< KeyType, ValueType >::remove( const LookupKey & key, const Compare & comp )
+{
+    remove(m_root, key, comp);
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::preorder( Function && visit ) const
+{
+    preorder(static_cast< const BTNode * >( m_root ), visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::preorder( Function && visit )
+{
+    preorder(m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::postorder( Function && visit ) const
+{
+    postorder(static_cast< const BTNode * >( m_root ), visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::postorder( Function && visit )
+{
+    postorder(m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::inorder( Function && visit ) const
+{
+    inorder(static_cast< const BTNode * >( m_root ), visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::inorder( Function && visit )
+{
+    inorder(m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::levelorder( Function && visit ) const
+{
+    levelorder(static_cast< const BTNode * >( m_root ), visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::levelorder( Function && visit )
+{
+    levelorder(m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit ) const
+{
+    for_each_in_range(static_cast< const BTNode * >( m_root ), lo, hi, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit )
+{
+    for_each_in_range(m_root, lo, hi, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::inorder_chunks( Function && visit ) const 
+{
+    inorder_chunks(static_cast< const BTNode * >( m_root ), visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type BST< KeyType, ValueType >::inorder_chunks( Function && visit ) 
+{
+    inorder_chunks(m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename UnaryPredicate >
+const ValueType * BST< KeyType, ValueType >::find_if( const UnaryPredicate & pred ) const 
+{
+    const ValueType * found = nullptr;
+
+    auto stop_at_match = [&]( const ValueType & value ) -> bool
+    {
+        if(pred(value))
+        {
+            found = &value;
+            return false; // Stop, we have our answer.
+        }
+        return true;
+    };
+    inorder(static_cast< const BTNode * >( m_root ), stop_at_match);
+
+    return found;
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::clear( void )
+{
+    return clear(m_root);
+}
+
+template < typename KeyType, typename ValueType >
 void BST< KeyType, ValueType >::insert( const KeyType & key , const ValueType & value )
 {
     return insert(m_root, key, value);
 }
 
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::insert_hint( const KeyType & key , const ValueType & value )
+{
+    insert_near_finger(key, value, false);
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::insert_near_finger( const KeyType & key, const ValueType & value, bool keep_equal )
+{
+    if(m_finger.empty())
+    {
+        m_finger.push_back({ &m_root, nullptr, nullptr });
+    }
+
+    // Climb back the finger until the subtree covers the key. The root covers every key.
+    while(m_finger.size() > 1)
+    {
+        const FingerStep & step = m_finger.back();
+        // With keep_equal, the subtree below an equivalent upper bound also takes the key.
+        if((step.lower == nullptr || m_key_less(step.lower->key, key)) &&
+           (step.upper == nullptr || ( keep_equal ? !m_key_less(step.upper->key, key) : m_key_less(key, step.upper->key) )))
+        {
+            break;
+        }
+        m_finger.pop_back();
+    }
+
+    // Descend from there, extending the finger.
+    while(true)
+    {
+        FingerStep step = m_finger.back();
+        BTNode * node = *step.slot;
+
+        if(node == nullptr)
+        {
+            *step.slot = create_node(key, value);
+            m_n_nodes++;
+            note_insertion(*step.slot, m_finger.size());
+            return;
+        }
+
+        if(m_key_less(node->key, key))
+        {
+            m_finger.push_back({ &node->left, node, step.upper });
+        }
+        else if(keep_equal || m_key_less(key, node->key))
+        {
+            m_finger.push_back({ &node->right, step.lower, node });
+        }
+        else
+        {
+            return; // The key is already in the tree.
+        }
+    }
+}
+
 template < typename KeyType, typename ValueType >
 void BST< KeyType, ValueType >::remove( const KeyType & key )
 {
-    remove(m_root, key);
+    remove(m_root, key, m_key_less);
+}
+
+template < typename KeyType, typename ValueType >
+size_t BST< KeyType, ValueType >::erase_range( const KeyType & lo, const KeyType & hi )
+{
+    BTNode * before = nullptr;
+    BTNode * rest = nullptr;
+    BTNode * in_range = nullptr;
+    BTNode * after = nullptr;
+
+    split(m_root, [&]( const KeyType & key ) { return m_key_less(key, lo); }, before, rest);
+    split(rest, [&]( const KeyType & key ) { return !m_key_less(hi, key); }, in_range, after);
+
+    forget_all_cached();
+    m_finger.clear();
+    abandon_rebalance();
+    size_t n_erased = free_subtree(in_range);
+    m_n_nodes -= n_erased;
+    m_root = join(before, after);
+
+    return n_erased;
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::relayout( void )
+{
+    if(m_root == nullptr)
+    {
+        release_blocks();
+        return;
+    }
+
+    std::vector< BTNode * > order;
+    order.reserve(m_n_nodes);
+    veb_order(m_root, height(m_root), order);
+
+    // (1) Build every node in the new block. Keys and values are moved only if that cannot throw,
+    //     otherwise they are copied, and a failed copy leaves the tree as it was.
+    typedef std::integral_constant< bool, std::is_nothrow_move_constructible< KeyType >::value &&
+                                          std::is_nothrow_move_constructible< ValueType >::value > can_move;
+    BTNode * block = std::allocator< BTNode >().allocate(order.size());
+    size_t n_built = 0;
+    try
+    {
+        for(; n_built < order.size(); ++n_built)
+        {
+            relocate_node(block + n_built, *order[n_built], can_move());
+        }
+    }
+    catch(...)
+    {
+        while(n_built > 0)
+        {
+            block[--n_built].~BTNode();
+        }
+        std::allocator< BTNode >().deallocate(block, order.size());
+        throw;
+    }
+
+    // (2) Nothing may fail from here on: replace the old nodes by the address they moved to.
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        order[i]->~BTNode();
+        ::new ( static_cast< void * >( order[i] ) ) BTNode *( block + i );
+    }
+
+    // (3) Redirect the links to the new addresses.
+    auto moved_to = []( BTNode * old_node ) -> BTNode *
+    {
+        return old_node != nullptr ? *reinterpret_cast< BTNode ** >( old_node ) : nullptr;
+    };
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        block[i].left = moved_to(block[i].left);
+        block[i].right = moved_to(block[i].right);
+    }
+    m_root = moved_to(m_root);
+    m_rebalance.owner = moved_to(m_rebalance.owner);
+    m_rebalance.anchor = moved_to(m_rebalance.anchor);
+
+    // (4) The old blocks only hold forwarding addresses now.
+    forget_all_cached();
+    m_finger.clear();
+    release_blocks();
+    m_blocks.push_back(block_type(block, order.size()));
+    m_capacity = order.size();
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::rebalance( void )
+{
+    if(m_rebalance.phase == RebalanceJob::Phase::IDLE || m_rebalance.owner != nullptr)
+    {
+        start_rebalance(nullptr, false, m_n_nodes);
+    }
+
+    while(rebalance_step())
+    {
+        /* empty */
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::enable_incremental_rebalance( double max_height_factor, size_t steps_per_operation )
+{
+    if(max_height_factor <= 0)
+    {
+        disable_incremental_rebalance();
+        return;
+    }
+
+    m_max_height_factor = max_height_factor;
+    m_rebalance_steps = std::max< size_t >(steps_per_operation, 4);
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::disable_incremental_rebalance( void )
+{
+    m_max_height_factor = 0;
+    m_rebalance_steps = 0;
+    abandon_rebalance();
+}
+
+template < typename KeyType, typename ValueType >
+typename BST< KeyType, ValueType >::MemoryUsage BST< KeyType, ValueType >::memory_usage( void ) const
+{
+    MemoryUsage usage;
+    usage.payload = m_n_nodes * ( sizeof(KeyType) + sizeof(ValueType) );
+    usage.pointers = m_n_nodes * 2 * sizeof(BTNode *);
+    usage.padding = m_n_nodes * sizeof(BTNode) - usage.payload - usage.pointers;
+    usage.slack = ( m_capacity - m_n_nodes ) * sizeof(BTNode);
+    usage.bookkeeping = sizeof(*this) + m_blocks.capacity() * sizeof(block_type)
+                      + m_cache.capacity() * sizeof(BTNode *) + m_finger.capacity() * sizeof(FingerStep);
+
+    return usage;
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::shrink_to_fit( void )
+{
+    if(m_capacity > m_n_nodes)
+    {
+        relayout();
+    }
+
+    m_finger.clear();
+    m_finger.shrink_to_fit();
+    m_blocks.shrink_to_fit();
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::enable_lookup_cache( size_t n_slots, const KeyTypeHash & hash )
+{
+    // Round up to a power of two, with at least two slots.
+    unsigned log_slots = 1;
+    while((size_t(1) << log_slots) < n_slots)
+    {
+        log_slots++;
+    }
+
+    m_cache.assign(size_t(1) << log_slots, nullptr);
+    m_cache_shift = 64 - log_slots;
+    m_cache_hash = hash;
+    m_cache_hits = 0;
+    m_cache_misses = 0;
+}
+
+template < typename KeyType, typename ValueType >
+void BST< KeyType, ValueType >::disable_lookup_cache( void )
+{
+    m_cache.clear();
+    m_cache.shrink_to_fit();
+    m_cache_hash = nullptr;
+    m_cache_shift = 0;
 }
@@ -0,0 +1,443 @@
+#pragma once
+#include <iostream>   // cout, cin, endl
+#include <functional> // std::function
+#include <utility>    // std::pair<>, std::forward
+#include <cstdint>    // uint32_t
+#include <limits>     // std::numeric_limits
+#include <stdexcept>  // std::out_of_range, std::runtime_error, std::length_error
+#include <stack>      // std::stack
+#include <queue>      // std::queue
+#include <vector>     // std::vector
+#include <type_traits> // std::is_void, std::decay, std::enable_if
+#include <initializer_list> // std::initializer_list
+
+#include "visitor.h"
+
+
+//!  This class implements a generic Binary Search Tree with compact, index-based node storage.
+/*!
+  CompactBST offers the lookup, traversal and modifier members of BST, but stores all of its
+  nodes in a single contiguous `std::vector`. A node refers to its children by 32-bit indices into that vector,
+  rather than by 64-bit pointers, which halves the link overhead of each node and keeps the
+  nodes close together in memory.
+  For small keys and values (e.g. `uint32_t` key and value) a node takes 16 bytes,
+  against the 24 bytes of a BST node.
+
+  Nodes released by remove() are recycled by subsequent insertions, and clear() simply
+  resets the vector, which is O(1) for trivially destructible keys and values.
+  The tree holds at most `2^32 - 1` nodes.
+
+  Keys are placed in the tree exactly as in BST, so both trees yield the same traversals
+  for the same sequence of insertions.
+  The BST members that manage pointer nodes or reshape the tree are not offered: the access
+  policy and lookup cache, height(), relayout(), rebalance() and incremental rebalancing,
+  assign(), memory_usage() and shrink_to_fit().
+
+  @tparam KeyType The type of the key associated with the data.
+  @tparam ValueType The type of the data to be stored in the tree.
+*/
+template < typename KeyType, typename ValueType >
+class CompactBST
+{
+    public:
+        //=== alias
+        typedef std::function<bool(const KeyType& a, const KeyType& b) > KeyTypeLess;
+        typedef uint32_t index_type; //!< The type of the links between nodes.
+
+    private:
+        //! Represents the absence of a node (the null link).
+        static const index_type null_index = std::numeric_limits< index_type >::max();
+
+        //=== Definition of a CompactBST node.
+        //! Represents a single binary search tree node.
+        struct BTNode {
+            KeyType key;   //!< The unique key.
+            ValueType data; //!< The data stored in a node.
+            index_type left;  //!< Index of the left child (subtree), or `null_index`.
+            index_type right; //!< Index of the right child (subtree), or `null_index`.
+
+            //! Default constructor for a tree node.
+            BTNode( const KeyType & k_=KeyType(), const ValueType & d_=ValueType(),
+                    index_type lt_=null_index, index_type rt_=null_index )
+                : key( k_ )
+                , data( d_ )
+                , left( lt_ )
+                , right( rt_ )
+                { /* empty */ }
+        };
+
+        //! A step of the insertion finger: a link on the path to the last hinted insertion.
+        /*! The subtree hanging from the link holds only keys that come after `lower`
+         *  and before `upper` (`null_index` means no restriction on that side).
+         */
+        struct FingerStep {
+            index_type parent; //!< The node the link leaves from, or `null_index` for the root link.
+            bool go_left; //!< Whether the link is the left link of `parent`.
+            index_type lower; //!< Every key in the subtree comes after this node's key.
+            index_type upper; //!< Every key in the subtree comes before this node's key.
+        };
+
+        std::vector< BTNode > m_nodes; //!< The storage of every node, including released ones.
+        index_type m_root; //!< Index of the root of the entire tree.
+        index_type m_free; //!< Head of the list of released nodes, chained through their `left` links.
+        size_t m_n_nodes; //!< The count of nodes stored in the tree.
+        KeyTypeLess m_key_less; //!< The key comparator function object.
+        std::vector< FingerStep > m_finger; //!< The path from the root to the last hinted insertion. Emptied by removals.
+
+
+        //=== INTERNAL MEMBERS
+
+        //! Looks for the node that stores a given key.
+        /*! @tparam LookupKey Either KeyType or any type `less` can compare with KeyType.
+         *  @tparam Compare The comparator, which must induce the same order as KeyTypeLess.
+         *  @param key The key we are looking for.
+         *  @param less The comparator used to compare `key` with the keys in the tree.
+         *  @param parent Receives the index of the last node visited before stopping, or `null_index`.
+         *  @param go_left Receives true if the search left `parent` through its left link.
+         *  @return The index of the node that stores `key`, or `null_index` if the key is not in the tree.
+         */
+        template < typename LookupKey, typename Compare >
+        index_type find_node( const LookupKey & key, const Compare & less, index_type & parent, bool & go_left ) const;
+
+        //! Looks for the node that stores a given key.
+        /*! @see find_node( const LookupKey & , const Compare & , index_type & , bool & ) const
+         */
+        template < typename LookupKey, typename Compare >
+        index_type find_node( const LookupKey & key, const Compare & less ) const;
+
+        //! Looks for the node with the first key that does not come before a given key.
+        /*! @see find_node( const LookupKey & , const Compare & , index_type & , bool & ) const
+         *  @return The index of the node found, or `null_index` if every key in the tree comes before `key`.
+         */
+        template < typename LookupKey, typename Compare >
+        index_type lower_bound_node( const LookupKey & key, const Compare & less ) const;
+
+        //! Returns the link that leaves `parent` on the requested side, or the root link if `parent` is `null_index`.
+        index_type & link( index_type parent, bool go_left );
+
+        //! Stores a new node, reusing a released one if possible.
+        /*! @return The index of the new node.
+         *  @throw std::length_error if the tree has no index left for a new node.
+         */
+        index_type allocate_node( const KeyType & key, const ValueType & value );
+
+        //! Releases a node, so that a future insertion may reuse it.
+        void release_node( index_type node );
+
+        //! Inserts the node `<key, value>` under the link found by find_node(), returning its index.
+        index_type attach( index_type parent, bool go_left, const KeyType & key, const ValueType & value );
+
+        //! Removes a node found by find_node() from the tree.
+        /*! @param node The index of the node to be removed.
+         *  @param parent The index of the parent of `node`, or `null_index` if it is the root.
+         *  @param go_left Whether `node` hangs from the left link of `parent`.
+         */
+        void unlink( index_type node, index_type parent, bool go_left );
+
+        //! Releases all the nodes of a (sub)tree, without recursion.
+        /*! The count of nodes is **not** updated.
+         *  @param root The index of the root of the (sub)tree we want to release.
+         *  @return The number of nodes released.
+         */
+        size_t free_subtree( index_type root );
+
+        //! Splits a tree in two according to a monotone key predicate, in O(h).
+        /*! `first` receives the nodes whose keys satisfy `goes_first`, and `second` the remaining nodes.
+         *  @see BST::split()
+         */
+        template < typename KeyPredicate >
+        void split( index_type root, const KeyPredicate & goes_first, index_type & first, index_type & second );
+
+        //! Joins two trees into one, assuming every key in `first` comes before every key in `second`.
+        /*! @see BST::join()
+         *  @return The index of the root of the joined tree.
+         */
+        index_type join( index_type first, index_type second );
+
+        //=== Tree traversal members
+        //! Traverses and visits each node in **preorder** fashion.
+        /*! @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting().
+         *  @param nodes A pointer to the node storage.
+         *  @param root The index of the root of the tree we want to traverse.
+         *  @param visit The function object to be applied to each node stored in the tree.
+         *  @return true if every node has been visited, false if `visit` stopped the traversal.
+         */
+        template < typename NodePointer, typename Function >
+        static bool preorder( NodePointer nodes, index_type root, Function & visit );
+
+        //! Traverses and visits each node in **postorder** fashion.
+        /*! @see preorder( NodePointer , index_type , Function & )
+         */
+        template < typename NodePointer, typename Function >
+        static bool postorder( NodePointer nodes, index_type root, Function & visit );
+
+        //! Traverses and visits each node in **inorder** fashion.
+        /*! @see preorder( NodePointer , index_type , Function & )
+         */
+        template < typename NodePointer, typename Function >
+        static bool inorder( NodePointer nodes, index_type root, Function & visit );
+
+        //! Traverses and visits each node in **level order** fashion.
+        /*! @see preorder( NodePointer , index_type , Function & )
+         */
+        template < typename NodePointer, typename Function >
+        static bool levelorder( NodePointer nodes, index_type root, Function & visit );
+
+        //! Visits, in **inorder**, the nodes whose keys lie in the range `[lo, hi]`.
+        /*! @see preorder( NodePointer , index_type , Function & )
+         */
+        template < typename NodePointer, typename Function >
+        void for_each_in_range( NodePointer nodes, index_type root, const KeyType & lo, const KeyType & hi, Function & visit ) const;
+
+        //! Traverses the tree in **inorder**, handing the values to `visit` in chunks.
+        /*! @tparam Function A visitor accepted by bst_detail::keep_visiting_chunk().
+         *  @see preorder( NodePointer , index_type , Function & )
+         */
+        template < typename NodePointer, typename Function >
+        static void inorder_chunks( NodePointer nodes, index_type root, Function & visit );
+
+
+    public:
+        //=== alias
+        typedef std::pair<KeyType, ValueType> node_content_type; //!< Represents a pair of key-value elements.
+        static const size_t chunk_size = 64; //!< The largest chunk of values handed over by inorder_chunks().
+        //=== special member
+        //! Default constructor.
+        /*!
+         *  Creates an empty tree.
+         *  @param comp The function object necessary to compare keys.
+         */
+        explicit CompactBST( const KeyTypeLess & comp = KeyTypeLess() )
+            : m_root( null_index )
+            , m_free( null_index )
+            , m_n_nodes( 0 )
+            , m_key_less( comp )
+            {/* empty */}
+
+        //! The range constructor.
+        /*!
+         *  Creates a new tree inserting key-value elements from the range `[first, last)` provided.
+         *  If multiple elements in the range have keys that compare equivalent,
+         *  only the first instance of the pair key-value is inserted.
+         *  @tparam InputItr The input iterator to the range we insert from.
+         *  @param first the begining of the range to copy from.
+         *  @param last the end (exclusive) of the range to copy from.
+         *  @param comp The function object necessary to compare keys.
+         */
+        template < typename InputItr >
+        CompactBST( InputItr first, InputItr last, const KeyTypeLess & comp = KeyTypeLess() );
+
+        //! The intializer list constructor.
+        /*!
+         *  Creates a new tree inserting key-value elements from the initializer list `init` provided.
+         *  If multiple elements in the initialize list have keys that compare equivalent,
+         *  only the first instance of the pair key-value is inserted.
+         *  @param init The initializer list to initialize the elements of the tree with.
+         *  @param comp The function object necessary to compare keys.
+         */
+        CompactBST( std::initializer_list< node_content_type > init , const KeyTypeLess & comp = KeyTypeLess());
+
+        //! The initializer list assignment operator.
+        /*!
+         *  Replaces the current content with the contents from the intializer list `ilist`.
+         *  @param ilist The initialize list to use as data source.
+         *  @return `*this` to enable chained assignments.
+         */
+        CompactBST & operator=( std::initializer_list< node_content_type > ilist );
+
+        // Copies are plain copies of the node storage, so the implicit members are used.
+
+        //=== access members
+        //! Returns the value associated with the smallest key.
+        const ValueType & find_min( void ) const;
+        //! Returns the value associated with the largest key.
+        const ValueType & find_max( void ) const;
+
+        //! Checks whether the tree contains a given key.
+        bool contains( const KeyType & key ) const;
+
+        //! Returns true if the tree is empty, or false otherwise.
+        inline bool empty( void ) const { return m_n_nodes == 0; };
+        //! Returns the number of key-value elements stored in the tree.
+        inline size_t size( void ) const { return m_n_nodes; };
+
+        //! Retrieves in `value` the value associated with the provided key.
+        /*! @param key The key we are looking for.
+         *  @param value The value associated with the target key we copied into.
+         *  @return true if key is found in the tree and the data is retrieved in value, false otherwise.
+         */
+        bool retrieve( const KeyType & key, ValueType & value ) const;
+
+        //! Returns a pointer to the value associated with the provided key, or `nullptr`.
+        /*! The pointer remains valid until the next insertion or removal, which may move the nodes.
+         */
+        const ValueType * find( const KeyType & key ) const;
+        //! Returns a pointer to the (modifiable) value associated with the provided key, or `nullptr`.
+        ValueType * find( const KeyType & key );
+
+        //! Returns a reference to the value associated with the provided key.
+        /*! @throw std::out_of_range if the key is not in the tree.
+         */
+        const ValueType & at( const KeyType & key ) const;
+        //! Returns a reference to the (modifiable) value associated with the provided key.
+        ValueType & at( const KeyType & key );
+
+        //! Returns a reference to the value associated with `key`, inserting <`key`,`ValueType()`> if needed.
+        ValueType & operator[]( const KeyType & key );
+
+        //! Returns a reference to the value associated with `key`, inserting <`key`,`value`> if needed.
+        ValueType & get_or_insert( const KeyType & key, const ValueType & value );
+
+        //! Returns a pointer to the value associated with the first key that does not come before `key`, or `nullptr`.
+        const ValueType * lower_bound( const KeyType & key ) const;
+
+        //=== heterogeneous lookup members
+        // Same requirements on `comp` as the BST heterogeneous lookups.
+
+        //! Checks whether the tree contains a key equivalent to `key`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+        contains( const LookupKey & key, const Compare & comp ) const;
+
+        //! Retrieves in `value` the value associated with a key equivalent to `key`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+        retrieve( const LookupKey & key, ValueType & value, const Compare & comp ) const;
+
+        //! Returns a pointer to the value associated with a key equivalent to `key`, or `nullptr`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+        find( const LookupKey & key, const Compare & comp ) const;
+        //! Returns a pointer to the (modifiable) value associated with a key equivalent to `key`, or `nullptr`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, ValueType * >::type
+        find( const LookupKey & key, const Compare & comp );
+
+        //! Returns a pointer to the value associated with the first key that does not come before `key`, or `nullptr`.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+        lower_bound( const LookupKey & key, const Compare & comp ) const;
+
+        //! Removes from the tree the node containing a key equivalent to `key`, if one is found.
+        template < typename LookupKey, typename Compare >
+        typename std::enable_if< bst_detail::is_transparent< Compare >::value >::type
+        remove( const LookupKey & key, const Compare & comp );
+
+        //=== tree traversal members
+        // Same visitor protocol as the BST traversals.
+
+        //! Traverses and visits each node in **preorder** fashion.
+        template < typename Function >
+        typename std::decay< Function >::type preorder( Function && visit ) const ;
+        //! Traverses the tree in **preorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type preorder( Function && visit );
+
+        //! Traverses and visits each node in **postorder** fashion.
+        template < typename Function >
+        typename std::decay< Function >::type postorder( Function && visit ) const ;
+        //! Traverses the tree in **postorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type postorder( Function && visit );
+
+        //! Traverses and visits each node in **inorder** fashion.
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit ) const ;
+        //! Traverses the tree in **inorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit );
+
+        //! Traverses and visits each node in **level order** fashion.
+        template < typename Function >
+        typename std::decay< Function >::type levelorder( Function && visit ) const ;
+        //! Traverses the tree in **level order**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type levelorder( Function && visit );
+
+        //! Visits, in **inorder**, the nodes whose keys lie in the range `[lo, hi]`, in O(h + k).
+        template < typename Function >
+        typename std::decay< Function >::type for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit ) const ;
+        //! Visits the nodes in the range `[lo, hi]`, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit );
+
+        //! Traverses the tree in **inorder**, handing the values over in chunks of `( const ValueType * const * values, size_t n )`.
+        template < typename Function >
+        typename std::decay< Function >::type inorder_chunks( Function && visit ) const ;
+        //! Traverses the tree in **inorder** chunks of `( ValueType * const * values, size_t n )`, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type inorder_chunks( Function && visit );
+
+        //! Returns the first value, in **inorder**, that satisfies a predicate, or `nullptr` if there is none.
+        template < typename UnaryPredicate >
+        const ValueType * find_if( const UnaryPredicate & pred ) const ;
+
+        //=== MODIFIER MEMBERS
+
+        //! Removes all the elements from the tree.
+        /*! The node storage is reset, but its capacity is kept for future insertions.
+         */
+        void clear( void );
+
+        //! Reserves storage for `n` nodes, so that the next insertions do not move the nodes.
+        void reserve( size_t n );
+
+        //! Inserts a new pair <`key`,`value`> in the tree, if the key is not already stored in the tree.
+        void insert( const KeyType & key , const ValueType & value );
+
+        //! Inserts a new pair <`key`,`value`> in the tree, starting from the last hinted insertion.
+        /*! Same finger search as BST::insert_hint(): amortized O(1) comparisons for nearly sorted keys.
+         *  The finger survives other insertions and is dropped by removals.
+         */
+        void insert_hint( const KeyType & key , const ValueType & value );
+
+        //! Removes from the tree the node containing the requested key, if one is found.
+        void remove( const KeyType & key );
+
+        //! Removes from the tree all the nodes whose keys lie in the range `[lo, hi]`.
+        /*! As in BST, the tree is split around the range and the remaining parts are joined back, in O(h + k).
+         *  @return The number of nodes removed.
+         */
+        size_t erase_range( const KeyType & lo, const KeyType & hi );
+
+
+        //=== FRIEND FUNCTION
+        //! Prints out an ascii tree-bar representation of the tree.
+        /*!
+         *  Same format as the BST output: left subtrees appear before right subtrees
+         *  and null nodes are represented with `X`.
+         */
+        friend std::ostream& operator<< ( std::ostream& os_, const CompactBST & root_ )
+        {
+            if ( root_.empty() )
+            {
+                os_ << "<empty tree>";
+                return os_;
+            }
+
+            typedef std::pair< size_t, index_type > stack_type;
+            std::stack< stack_type > s;
+            s.push( std::make_pair( 0, root_.m_root ) ); // push root at level 0.
+
+            while( not s.empty() )
+            {
+                auto visited = s.top(); s.pop();
+                for( auto i(0u) ; i < visited.first ; ++i )
+                    os_ << "--";
+                if ( visited.second == null_index )
+                {
+                    os_ << "X\n";
+                    continue;
+                }
+                const BTNode & node = root_.m_nodes[ visited.second ];
+                os_ << node.data << "\n";
+
+                s.push( std::make_pair( visited.first+1, node.right ) );
+                s.push( std::make_pair( visited.first+1, node.left ) );
+            }
+            return os_;
+        }
+};
+
+#include "compact_bst.inl"
@@ -0,0 +1,888 @@
+#include "compact_bst.h"
+
+template < typename KeyType, typename ValueType >
+const typename CompactBST< KeyType, ValueType >::index_type CompactBST< KeyType, ValueType >::null_index;
+
+template < typename KeyType, typename ValueType >
+const size_t CompactBST< KeyType, ValueType >::chunk_size;
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename CompactBST< KeyType, ValueType >::index_type
+CompactBST< KeyType, ValueType >::find_node( const LookupKey & key, const Compare & less, index_type & parent, bool & go_left ) const
+{
+    index_type root = m_root;
+    parent = null_index;
+    go_left = false;
+
+    while(root != null_index)
+    {
+        const BTNode & node = m_nodes[root];
+        if(less(node.key, key))
+        {
+            parent = root;
+            go_left = true;
+            root = node.left;
+        }
+        else if(!less(key, node.key))
+        {
+            return root;
+        }
+        else
+        {
+            parent = root;
+            go_left = false;
+            root = node.right;
+        }
+    }
+
+    return null_index;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename CompactBST< KeyType, ValueType >::index_type
+CompactBST< KeyType, ValueType >::find_node( const LookupKey & key, const Compare & less ) const
+{
+    index_type parent;
+    bool go_left;
+    return find_node(key, less, parent, go_left);
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename CompactBST< KeyType, ValueType >::index_type
+CompactBST< KeyType, ValueType >::lower_bound_node( const LookupKey & key, const Compare & less ) const
+{
+    index_type root = m_root;
+    index_type bound = null_index;
+
+    while(root != null_index)
+    {
+        const BTNode & node = m_nodes[root];
+        if(less(node.key, key))
+        {
+            // The node comes before the key, look among the larger keys.
+            root = node.left;
+        }
+        else
+        {
+            // The node is a candidate, but a smaller key might still qualify.
+            bound = root;
+            root = node.right;
+        }
+    }
+
+    return bound;
+}
+
+template < typename KeyType, typename ValueType >
+typename CompactBST< KeyType, ValueType >::index_type &
+CompactBST< KeyType, ValueType >::link( index_type parent, bool go_left )
+{
+    if(parent == null_index)
+    {
+        return m_root;
+    }
+
+    return go_left ? m_nodes[parent].left : m_nodes[parent].right;
+}
+
+template < typename KeyType, typename ValueType >
+typename CompactBST< KeyType, ValueType >::index_type
+CompactBST< KeyType, ValueType >::allocate_node( const KeyType & key, const ValueType & value )
+{
+    if(m_free != null_index)
+    {
+        index_type node = m_free;
+        m_free = m_nodes[node].left;
+        m_nodes[node] = BTNode(key, value);
+        return node;
+    }
+
+    if(m_nodes.size() >= null_index)
+    {
+        throw std::length_error("allocate_node: no index left for a new node");
+    }
+
+    m_nodes.push_back(BTNode(key, value));
+    return static_cast< index_type >( m_nodes.size() - 1 );
+}
+
+template < typename KeyType, typename ValueType >
+void CompactBST< KeyType, ValueType >::release_node( index_type node )
+{
+    // Drop the payload right away, in case it holds resources of its own.
+    m_nodes[node] = BTNode(KeyType(), ValueType(), m_free, null_index);
+    m_free = node;
+}
+
+template < typename KeyType, typename ValueType >
+typename CompactBST< KeyType, ValueType >::index_type
+CompactBST< KeyType, ValueType >::attach( index_type parent, bool go_left, const KeyType & key, const ValueType & value )
+{
+    // Allocate first: growing the storage would invalidate a reference to the link.
+    index_type node = allocate_node(key, value);
+    link(parent, go_left) = node;
+    m_n_nodes++;
+
+    return node;
+}
+
+template < typename KeyType, typename ValueType >
+void CompactBST< KeyType, ValueType >::unlink( index_type node, index_type parent, bool go_left )
+{
+    // The finger may refer to the successor moved below.
+    m_finger.clear();
+
+    BTNode & target = m_nodes[node];
+    if(target.left != null_index && target.right != null_index)
+    {
+        // Replace the target by the smallest key of its right subtree, and remove that node instead.
+        index_type successor_parent = node;
+        index_type successor = target.right;
+        go_left = false;
+        while(m_nodes[successor].left != null_index)
+        {
+            successor_parent = successor;
+            successor = m_nodes[successor].left;
+            go_left = true;
+        }
+
+        target.key = m_nodes[successor].key;
+        target.data = m_nodes[successor].data;
+        parent = successor_parent;
+        node = successor;
+    }
+
+    // Here the node has at most one child.
+    index_type child = m_nodes[node].left != null_index ? m_nodes[node].left : m_nodes[node].right;
+    link(parent, go_left) = child;
+    release_node(node);
+    m_n_nodes--;
+}
+
+template < typename KeyType, typename ValueType >
+size_t CompactBST< KeyType, ValueType >::free_subtree( index_type root )
+{
+    size_t n_freed = 0;
+
+    // Rotate left children up so that every node is released once its left subtree is gone.
+    while(root != null_index)
+    {
+        BTNode & node = m_nodes[root];
+        if(node.left != null_index)
+        {
+            index_type child = node.left;
+            node.left = m_nodes[child].right;
+            m_nodes[child].right = root;
+            root = child;
+        }
+        else
+        {
+            index_type next = node.right;
+            release_node(root);
+            root = next;
+            n_freed++;
+        }
+    }
+
+    return n_freed;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename KeyPredicate >
+void CompactBST< KeyType, ValueType >::split( index_type root, const KeyPredicate & goes_first, index_type & first, index_type & second )
+{
+    index_type * first_slot = &first;
+    index_type * second_slot = &second;
+
+    while(root != null_index)
+    {
+        BTNode & node = m_nodes[root];
+        if(goes_first(node.key))
+        {
+            // The node and its right subtree (smaller keys) belong to the first tree.
+            *first_slot = root;
+            first_slot = &node.left;
+            root = node.left;
+        }
+        else
+        {
+            // The node and its left subtree (larger keys) belong to the second tree.
+            *second_slot = root;
+            second_slot = &node.right;
+            root = node.right;
+        }
+    }
+
+    *first_slot = null_index;
+    *second_slot = null_index;
+}
+
+template < typename KeyType, typename ValueType >
+typename CompactBST< KeyType, ValueType >::index_type
+CompactBST< KeyType, ValueType >::join( index_type first, index_type second )
+{
+    if(first == null_index)
+    {
+        return second;
+    }
+
+    // Detach the largest key of the first tree, and make it the root of both trees.
+    index_type * link = &first;
+    while(m_nodes[*link].left != null_index)
+    {
+        link = &m_nodes[*link].left;
+    }
+    index_type largest = *link;
+    *link = m_nodes[largest].right;
+    m_nodes[largest].left = second;
+    m_nodes[largest].right = first;
+
+    return largest;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool CompactBST< KeyType, ValueType >::preorder( NodePointer nodes, index_type root, Function & visit )
+{
+    if(root == null_index)
+    {
+        return true;
+    }
+
+    std::stack< index_type, std::vector< index_type > > s;
+    s.push(root);
+
+    while(!s.empty())
+    {
+        NodePointer node = nodes + s.top(); s.pop();
+
+        if(!bst_detail::keep_visiting(visit, node->key, node->data))
+        {
+            return false;
+        }
+
+        // Right goes first so that the left subtree is visited first.
+        if(node->right != null_index)
+        {
+            s.push(node->right);
+        }
+        if(node->left != null_index)
+        {
+            s.push(node->left);
+        }
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool CompactBST< KeyType, ValueType >::postorder( NodePointer nodes, index_type root, Function & visit )
+{
+    std::stack< index_type, std::vector< index_type > > s;
+    index_type last_visited = null_index;
+
+    while(root != null_index || !s.empty())
+    {
+        if(root != null_index)
+        {
+            s.push(root);
+            root = nodes[root].left;
+            continue;
+        }
+
+        index_type top = s.top();
+        if(nodes[top].right != null_index && nodes[top].right != last_visited)
+        {
+            // The right subtree has not been visited yet.
+            root = nodes[top].right;
+        }
+        else
+        {
+            if(!bst_detail::keep_visiting(visit, nodes[top].key, nodes[top].data))
+            {
+                return false;
+            }
+            last_visited = top;
+            s.pop();
+        }
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool CompactBST< KeyType, ValueType >::inorder( NodePointer nodes, index_type root, Function & visit )
+{
+    std::stack< index_type, std::vector< index_type > > s;
+
+    while(root != null_index || !s.empty())
+    {
+        while(root != null_index)
+        {
+            s.push(root);
+            root = nodes[root].left;
+        }
+
+        root = s.top(); s.pop();
+
+        if(!bst_detail::keep_visiting(visit, nodes[root].key, nodes[root].data))
+        {
+            return false;
+        }
+
+        root = nodes[root].right;
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+bool CompactBST< KeyType, ValueType >::levelorder( NodePointer nodes, index_type root, Function & visit )
+{
+    if(root == null_index)
+    {
+        return true;
+    }
+
+    std::queue< index_type > q;
+    q.push(root);
+
+    while(!q.empty())
+    {
+        NodePointer node = nodes + q.front(); q.pop();
+
+        if(!bst_detail::keep_visiting(visit, node->key, node->data))
+        {
+            return false;
+        }
+
+        if(node->left != null_index)
+        {
+            q.push(node->left);
+        }
+        if(node->right != null_index)
+        {
+            q.push(node->right);
+        }
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+void CompactBST< KeyType, ValueType >::for_each_in_range( NodePointer nodes, index_type root, const KeyType & lo, const KeyType & hi, Function & visit ) const
+{
+    std::stack< index_type, std::vector< index_type > > s;
+
+    while(root != null_index || !s.empty())
+    {
+        // The left subtree holds larger keys: worth exploring only if its root's key <= hi.
+        while(root != null_index)
+        {
+            s.push(root);
+            root = !m_key_less(hi, nodes[root].key) ? nodes[root].left : null_index;
+        }
+
+        NodePointer node = nodes + s.top(); s.pop();
+
+        bool not_before_lo = !m_key_less(node->key, lo);
+        if(not_before_lo && !m_key_less(hi, node->key))
+        {
+            if(!bst_detail::keep_visiting(visit, node->key, node->data))
+            {
+                return;
+            }
+        }
+
+        // The right subtree holds smaller keys: worth exploring only if the node's key >= lo.
+        root = not_before_lo ? node->right : null_index;
+    }
+}
+
+template < typename KeyType, typename ValueType >
+template < typename NodePointer, typename Function >
+void CompactBST< KeyType, ValueType >::inorder_chunks( NodePointer nodes, index_type root, Function & visit )
+{
+    typedef decltype( &nodes->data ) ValuePointer; // Carries the constness of the traversal.
+    ValuePointer chunk[chunk_size];
+    size_t n_gathered = 0;
+
+    auto gather = [&]( typename std::remove_pointer< ValuePointer >::type & value ) -> bool
+    {
+        chunk[n_gathered++] = &value;
+        if(n_gathered < chunk_size)
+        {
+            return true;
+        }
+        n_gathered = 0;
+        return bst_detail::keep_visiting_chunk(visit, chunk, chunk_size);
+    };
+
+    if(inorder(nodes, root, gather) && n_gathered > 0)
+    {
+        bst_detail::keep_visiting_chunk(visit, chunk, n_gathered);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+template < typename InputItr >
+CompactBST< KeyType, ValueType >::CompactBST( InputItr first, InputItr last, const KeyTypeLess & comp )
+    : m_root( null_index )
+    , m_free( null_index )
+    , m_n_nodes( 0 )
+    , m_key_less( comp )
+{
+    for(auto it=first; it!= last; it++)
+    {
+        insert((*it).first, (*it).second);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+CompactBST< KeyType, ValueType >::CompactBST( std::initializer_list< node_content_type > init , const KeyTypeLess & comp )
+    : m_root( null_index )
+    , m_free( null_index )
+    , m_n_nodes( 0 )
+    , m_key_less( comp )
+{
+    *this = init;
+}
+
+template < typename KeyType, typename ValueType >
+CompactBST< KeyType, ValueType > & CompactBST< KeyType, ValueType >::operator=( std::initializer_list< node_content_type > ilist )
+{
+    clear();
+    reserve(ilist.size());
+
+    for(const auto & element: ilist)
+    {
+        insert(element.first, element.second);
+    }
+
+    return *this;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType & CompactBST< KeyType, ValueType >::find_min( void ) const
+{
+    if(m_root == null_index)
+    {
+        throw std::runtime_error("find_min: called upon an empty tree");
+    }
+
+    index_type node = m_root;
+    while(m_nodes[node].left != null_index)
+    {
+        node = m_nodes[node].left;
+    }
+
+    return m_nodes[node].data;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType & CompactBST< KeyType, ValueType >::find_max( void ) const
+{
+    if(m_root == null_index)
+    {
+        throw std::runtime_error("find_max: called upon an empty tree");
+    }
+
+    index_type node = m_root;
+    while(m_nodes[node].right != null_index)
+    {
+        node = m_nodes[node].right;
+    }
+
+    return m_nodes[node].data;
+}
+
+template < typename KeyType, typename ValueType >
+bool CompactBST< KeyType, ValueType >::contains( const KeyType & key ) const
+{
+    return find_node(key, m_key_less) != null_index;
+}
+
+template < typename KeyType, typename ValueType >
+bool CompactBST< KeyType, ValueType >::retrieve( const KeyType & key, ValueType & value ) const
+{
+    index_type node = find_node(key, m_key_less);
+
+    if(node == null_index)
+    {
+        return false;
+    }
+
+    value = m_nodes[node].data;
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType * CompactBST< KeyType, ValueType >::find( const KeyType & key ) const
+{
+    index_type node = find_node(key, m_key_less);
+    return node != null_index ? &m_nodes[node].data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType * CompactBST< KeyType, ValueType >::find( const KeyType & key )
+{
+    index_type node = find_node(key, m_key_less);
+    return node != null_index ? &m_nodes[node].data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType & CompactBST< KeyType, ValueType >::at( const KeyType & key ) const
+{
+    const ValueType * value = find(key);
+    if(value == nullptr)
+    {
+        throw std::out_of_range("at: key not found in the tree");
+    }
+
+    return *value;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType & CompactBST< KeyType, ValueType >::at( const KeyType & key )
+{
+    ValueType * value = find(key);
+    if(value == nullptr)
+    {
+        throw std::out_of_range("at: key not found in the tree");
+    }
+
+    return *value;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType & CompactBST< KeyType, ValueType >::operator[]( const KeyType & key )
+{
+    index_type parent;
+    bool go_left;
+    index_type node = find_node(key, m_key_less, parent, go_left);
+
+    if(node == null_index)
+    {
+        node = attach(parent, go_left, key, ValueType());
+    }
+
+    return m_nodes[node].data;
+}
+
+template < typename KeyType, typename ValueType >
+ValueType & CompactBST< KeyType, ValueType >::get_or_insert( const KeyType & key, const ValueType & value )
+{
+    index_type parent;
+    bool go_left;
+    index_type node = find_node(key, m_key_less, parent, go_left);
+
+    if(node == null_index)
+    {
+        node = attach(parent, go_left, key, value);
+    }
+
+    return m_nodes[node].data;
+}
+
+template < typename KeyType, typename ValueType >
+const ValueType * CompactBST< KeyType, ValueType >::lower_bound( const KeyType & key ) const
+{
+    index_type node = lower_bound_node(key, m_key_less);
+    return node != null_index ? &m_nodes[node].data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+CompactBST< KeyType, ValueType >::contains( const LookupKey & key, const Compare & comp ) const
+{
+    return find_node(key, comp) != null_index;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, bool >::type
+CompactBST< KeyType, ValueType >::retrieve( const LookupKey & key, ValueType & value, const Compare & comp ) const
+{
+    index_type node = find_node(key, comp);
+
+    if(node == null_index)
+    {
+        return false;
+    }
+
+    value = m_nodes[node].data;
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+CompactBST< KeyType, ValueType >::find( const LookupKey & key, const Compare & comp ) const
+{
+    index_type node = find_node(key, comp);
+    return node != null_index ? &m_nodes[node].data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, ValueType * >::type
+CompactBST< KeyType, ValueType >::find( const LookupKey & key, const Compare & comp )
+{
+    index_type node = find_node(key, comp);
+    return node != null_index ? &m_nodes[node].data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value, const ValueType * >::type
+CompactBST< KeyType, ValueType >::lower_bound( const LookupKey & key, const Compare & comp ) const
+{
+    index_type node = lower_bound_node(key, comp);
+    return node != null_index ? &m_nodes[node].data : nullptr;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename LookupKey, typename Compare >
+typename std::enable_if< bst_detail::is_transparent< Compare >::value >::type
+CompactBST< KeyType, ValueType >::remove( const LookupKey & key, const Compare & comp )
+{
+    index_type parent;
+    bool go_left;
+    index_type node = find_node(key, comp, parent, go_left);
+
+    if(node != null_index)
+    {
+        unlink(node, parent, go_left);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::preorder( Function && visit ) const
+{
+    preorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::preorder( Function && visit )
+{
+    preorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::postorder( Function && visit ) const
+{
+    postorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::postorder( Function && visit )
+{
+    postorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::inorder( Function && visit ) const
+{
+    inorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::inorder( Function && visit )
+{
+    inorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::levelorder( Function && visit ) const
+{
+    levelorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::levelorder( Function && visit )
+{
+    levelorder(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit ) const
+{
+    for_each_in_range(m_nodes.data(), m_root, lo, hi, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit )
+{
+    for_each_in_range(m_nodes.data(), m_root, lo, hi, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::inorder_chunks( Function && visit ) const
+{
+    inorder_chunks(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type CompactBST< KeyType, ValueType >::inorder_chunks( Function && visit )
+{
+    inorder_chunks(m_nodes.data(), m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename UnaryPredicate >
+const ValueType * CompactBST< KeyType, ValueType >::find_if( const UnaryPredicate & pred ) const
+{
+    const ValueType * found = nullptr;
+
+    auto stop_at_match = [&]( const ValueType & value ) -> bool
+    {
+        if(pred(value))
+        {
+            found = &value;
+            return false; // Stop, we have our answer.
+        }
+        return true;
+    };
+    inorder(m_nodes.data(), m_root, stop_at_match);
+
+    return found;
+}
+
+template < typename KeyType, typename ValueType >
+void CompactBST< KeyType, ValueType >::clear( void )
+{
+    m_finger.clear();
+    m_nodes.clear();
+    m_root = null_index;
+    m_free = null_index;
+    m_n_nodes = 0;
+}
+
+template < typename KeyType, typename ValueType >
+void CompactBST< KeyType, ValueType >::reserve( size_t n )
+{
+    m_nodes.reserve(n);
+}
+
+template < typename KeyType, typename ValueType >
+void CompactBST< KeyType, ValueType >::insert( const KeyType & key , const ValueType & value )
+{
+    index_type parent;
+    bool go_left;
+
+    if(find_node(key, m_key_less, parent, go_left) == null_index)
+    {
+        attach(parent, go_left, key, value);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void CompactBST< KeyType, ValueType >::insert_hint( const KeyType & key , const ValueType & value )
+{
+    if(m_finger.empty())
+    {
+        m_finger.push_back({ null_index, false, null_index, null_index });
+    }
+
+    // Climb back the finger until the subtree covers the key. The root covers every key.
+    while(m_finger.size() > 1)
+    {
+        const FingerStep & step = m_finger.back();
+        if((step.lower == null_index || m_key_less(m_nodes[step.lower].key, key)) &&
+           (step.upper == null_index || m_key_less(key, m_nodes[step.upper].key)))
+        {
+            break;
+        }
+        m_finger.pop_back();
+    }
+
+    // Descend from there, extending the finger.
+    while(true)
+    {
+        FingerStep step = m_finger.back();
+        index_type node = link(step.parent, step.go_left);
+
+        if(node == null_index)
+        {
+            attach(step.parent, step.go_left, key, value);
+            return;
+        }
+
+        if(m_key_less(m_nodes[node].key, key))
+        {
+            m_finger.push_back({ node, true, node, step.upper });
+        }
+        else if(m_key_less(key, m_nodes[node].key))
+        {
+            m_finger.push_back({ node, false, step.lower, node });
+        }
+        else
+        {
+            return; // The key is already in the tree.
+        }
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void CompactBST< KeyType, ValueType >::remove( const KeyType & key )
+{
+    index_type parent;
+    bool go_left;
+    index_type node = find_node(key, m_key_less, parent, go_left);
+
+    if(node != null_index)
+    {
+        unlink(node, parent, go_left);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+size_t CompactBST< KeyType, ValueType >::erase_range( const KeyType & lo, const KeyType & hi )
+{
+    index_type before = null_index;
+    index_type rest = null_index;
+    index_type in_range = null_index;
+    index_type after = null_index;
+
+    split(m_root, [&]( const KeyType & key ) { return m_key_less(key, lo); }, before, rest);
+    split(rest, [&]( const KeyType & key ) { return !m_key_less(hi, key); }, in_range, after);
+
+    m_finger.clear();
+    size_t n_erased = free_subtree(in_range);
+    m_n_nodes -= n_erased;
+    m_root = join(before, after);
+
+    return n_erased;
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include <iostream>   // cout, cin, endl
+#include <functional> // std::function
+#include <utility>    // std::pair<>, std::forward
+#include <stdexcept>  // std::invalid_argument
+#include <stack>      // std::stack
+#include <vector>     // std::vector
+#include <type_traits> // std::is_void, std::decay
+#include <initializer_list> // std::initializer_list
+#include <random>     // std::minstd_rand
+#include <cstdint>    // std::uint_fast32_t
+
+#include "visitor.h"
+
+
+//!  This class implements a Binary Search Tree of closed intervals, augmented for overlap queries.
+/*!
+  IntervalBST stores pairs <`[lo, hi]`, value>, ordered by the start of the interval
+  (and then by its end). Intervals may repeat, as several records may span the same range.
+
+  On top of the BST shape, every node keeps the largest end point found in its subtree.
+  That is enough to skip, during a query, every subtree in which no interval reaches the
+  query range, so overlapping() and stabbing() run in O(h + k h) in the worst case, and
+  close to O(h + k) in practice, where h is the height of the tree and k the number of
+  intervals reported; a plain BST keyed by start point has to scan all the earlier intervals.
+
+  The tree keeps itself balanced as a *treap*: every node draws a random priority, and
+  rotations keep each node's priority no lower than its children's. Whatever the order of
+  insertion (time-ordered records come sorted), the expected height is then O(log n), so
+  insert() and remove() take O(log n), and queries O(log n + k) in practice. Rotations
+  recompute the largest end point of the two nodes they move.
+
+  Intervals are placed in the tree as keys are in BST: those that come after a node
+  go to its left subtree, so inorder() visits them in reverse comparator order.
+
+  @tparam PointType The type of the interval end points.
+  @tparam ValueType The type of the data to be stored in the tree.
+*/
+template < typename PointType, typename ValueType >
+class IntervalBST
+{
+    public:
+        //=== alias
+        typedef std::function<bool(const PointType& a, const PointType& b) > PointTypeLess;
+        typedef std::pair< PointType, PointType > interval_type; //!< A closed interval `[first, second]`.
+
+    private:
+        //=== Definition of an IntervalBST node.
+        //! Represents a single tree node.
+        struct BTNode {
+            interval_type key; //!< The interval, which is the key of the node.
+            ValueType data;    //!< The data stored in a node.
+            PointType max_end; //!< The largest end point of all the intervals in this subtree.
+            std::uint_fast32_t priority; //!< The treap priority: no lower than the priorities of the children.
+            BTNode *left;  //!< Pointer to the left child (subtree).
+            BTNode *right; //!< Pointer to the right child (subtree).
+
+            //! Default constructor for a tree node.
+            BTNode( const interval_type & k_, const ValueType & d_, std::uint_fast32_t p_=0,
+                    BTNode * lt_=nullptr, BTNode * rt_=nullptr )
+                : key( k_ )
+                , data( d_ )
+                , max_end( k_.second )
+                , priority( p_ )
+                , left( lt_ )
+                , right( rt_ )
+                { /* empty */ }
+        };
+
+        BTNode *m_root; //!< Pointer to the root of the entire tree.
+        size_t m_n_nodes; //!< The count of nodes stored in the tree.
+        PointTypeLess m_point_less; //!< The end point comparator function object.
+        std::minstd_rand m_priorities; //!< Draws the treap priorities of new nodes.
+
+
+        //=== INTERNAL MEMBERS
+
+        //! Tells whether interval `a` comes before interval `b`: by start point, then by end point.
+        bool comes_before( const interval_type & a, const interval_type & b ) const;
+
+        //! Returns whichever of the two points comes last.
+        const PointType & last_of( const PointType & a, const PointType & b ) const;
+
+        //! Recomputes the largest end point of a node from its interval and its children.
+        void update_max_end( BTNode * node ) const;
+
+        //! Moves the left child of `*link` up in its place, updating the largest end points.
+        void rotate_right( BTNode ** link ) const;
+
+        //! Moves the right child of `*link` up in its place, updating the largest end points.
+        void rotate_left( BTNode ** link ) const;
+
+        //! Copies a tree, returning the root of the copy.
+        static BTNode * clone( const BTNode * root );
+
+        //! Deletes all the nodes of a tree.
+        static void free_subtree( BTNode * root );
+
+        //! Visits, in inorder, every interval of a tree that overlaps `[lo, hi]`.
+        /*! Subtrees whose largest end point comes before `lo`, and left subtrees of nodes that
+         *  start after `hi`, cannot hold any overlapping interval and are skipped.
+         *  @tparam NodePointer Either `BTNode *` or `const BTNode *`, which decides whether the values may be modified.
+         *  @tparam Function A visitor accepted by bst_detail::keep_visiting().
+         *  @param root A pointer to the tree we want to search.
+         *  @param lo The first point of the query range.
+         *  @param hi The last point of the query range.
+         *  @param visit The function object to be applied to each overlapping interval.
+         */
+        template < typename NodePointer, typename Function >
+        void overlapping( NodePointer root, const PointType & lo, const PointType & hi, Function & visit ) const ;
+
+        //! Traverses and visits each node in **inorder** fashion.
+        template < typename NodePointer, typename Function >
+        static void inorder( NodePointer root, Function & visit );
+
+
+    public:
+        //=== alias
+        typedef std::pair< interval_type, ValueType > node_content_type; //!< Represents a pair of interval-value elements.
+        //=== special member
+        //! Default constructor.
+        /*!
+         *  Creates an empty tree.
+         *  @param comp The function object necessary to compare end points.
+         */
+        explicit IntervalBST( const PointTypeLess & comp = PointTypeLess() )
+            : m_root( nullptr )
+            , m_n_nodes( 0 )
+            , m_point_less( comp )
+            {/* empty */}
+
+        //! The intializer list constructor.
+        /*!
+         *  Creates a new tree inserting every interval-value element from the initializer list `init` provided.
+         *  @param init The initializer list to initialize the elements of the tree with.
+         *  @param comp The function object necessary to compare end points.
+         */
+        IntervalBST( std::initializer_list< node_content_type > init , const PointTypeLess & comp = PointTypeLess() );
+
+        //! The copy constructor.
+        IntervalBST( const IntervalBST & other );
+
+        //! The copy assignment operator.
+        IntervalBST & operator=( const IntervalBST & rhs );
+
+        //! Destructor.
+        ~IntervalBST();
+
+        //=== access members
+        //! Returns true if the tree is empty, or false otherwise.
+        inline bool empty( void ) const { return m_n_nodes == 0; };
+        //! Returns the number of interval-value elements stored in the tree.
+        inline size_t size( void ) const { return m_n_nodes; };
+        //! Returns the number of levels of the tree, 0 for an empty tree. Runs in O(n).
+        size_t height( void ) const;
+
+        //! Visits every interval that overlaps the closed range `[lo, hi]`.
+        /*! Two closed intervals overlap if they share at least one point.
+         *  @tparam Function A function object of the form `std::function<void( const interval_type &, const ValueType  & )>`
+         *  or `std::function<void( const ValueType  & )>`, optionally returning `bool` to stop early.
+         *  @param lo The first point of the query range.
+         *  @param hi The last point of the query range.
+         *  @param visit The function object to be applied to each overlapping interval.
+         */
+        template < typename Function >
+        typename std::decay< Function >::type overlapping( const PointType & lo, const PointType & hi, Function && visit ) const ;
+        //! Visits every interval that overlaps `[lo, hi]`, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type overlapping( const PointType & lo, const PointType & hi, Function && visit );
+
+        //! Visits every interval that contains the point `point`.
+        /*! @see overlapping( const PointType & , const PointType & , Function && ) const
+         */
+        template < typename Function >
+        typename std::decay< Function >::type stabbing( const PointType & point, Function && visit ) const ;
+        //! Visits every interval that contains `point`, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type stabbing( const PointType & point, Function && visit );
+
+        //! Traverses and visits each node in **inorder** fashion.
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit ) const ;
+        //! Traverses the tree in **inorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit );
+
+        //=== MODIFIER MEMBERS
+
+        //! Removes all the elements from the tree.
+        void clear( void );
+
+        //! Inserts a new pair <`[lo, hi]`,`value`> in the tree, even if the interval is already stored in the tree.
+        /*! @throw std::invalid_argument if `hi` comes before `lo`.
+         */
+        void insert( const PointType & lo, const PointType & hi, const ValueType & value );
+
+        //! Removes from the tree one of the pairs whose interval is `[lo, hi]`.
+        /*! @return true if a pair has been removed, false if the interval is not in the tree.
+         */
+        bool remove( const PointType & lo, const PointType & hi );
+
+
+        //=== FRIEND FUNCTION
+        //! Prints out an ascii tree-bar representation of the tree.
+        /*!
+         *  Same format as the BST output: left subtrees appear before right subtrees
+         *  and null nodes are represented with `X`.
+         */
+        friend std::ostream& operator<< ( std::ostream& os_, const IntervalBST & root_ )
+        {
+            if ( root_.m_root == nullptr )
+            {
+                os_ << "<empty tree>";
+                return os_;
+            }
+
+            typedef std::pair< size_t, const BTNode* > stack_type;
+            std::stack< stack_type > s;
+            s.push( std::make_pair( 0, root_.m_root ) ); // push root at level 0.
+
+            while( not s.empty() )
+            {
+                auto visited = s.top(); s.pop();
+                for( auto i(0u) ; i < visited.first ; ++i )
+                    os_ << "--";
+                if ( visited.second == nullptr )
+                {
+                    os_ << "X\n";
+                    continue;
+                }
+                os_ << visited.second->data << "\n";
+
+                s.push( std::make_pair( visited.first+1, visited.second->right ) );
+                s.push( std::make_pair( visited.first+1, visited.second->left ) );
+            }
+            return os_;
+        }
+};
+
+#include "interval_bst.inl"
@@ -0,0 +1,404 @@
+#include "interval_bst.h"
+
+template < typename PointType, typename ValueType >
+bool IntervalBST< PointType, ValueType >::comes_before( const interval_type & a, const interval_type & b ) const
+{
+    if(m_point_less(a.first, b.first))
+    {
+        return true;
+    }
+
+    return !m_point_less(b.first, a.first) && m_point_less(a.second, b.second);
+}
+
+template < typename PointType, typename ValueType >
+const PointType & IntervalBST< PointType, ValueType >::last_of( const PointType & a, const PointType & b ) const
+{
+    return m_point_less(a, b) ? b : a;
+}
+
+template < typename PointType, typename ValueType >
+void IntervalBST< PointType, ValueType >::update_max_end( BTNode * node ) const
+{
+    node->max_end = node->key.second;
+    if(node->left != nullptr)
+    {
+        node->max_end = last_of(node->max_end, node->left->max_end);
+    }
+    if(node->right != nullptr)
+    {
+        node->max_end = last_of(node->max_end, node->right->max_end);
+    }
+}
+
+template < typename PointType, typename ValueType >
+void IntervalBST< PointType, ValueType >::rotate_right( BTNode ** link ) const
+{
+    BTNode * node = *link;
+    BTNode * child = node->left;
+    node->left = child->right;
+    child->right = node;
+    *link = child;
+
+    update_max_end(node);
+    update_max_end(child);
+}
+
+template < typename PointType, typename ValueType >
+void IntervalBST< PointType, ValueType >::rotate_left( BTNode ** link ) const
+{
+    BTNode * node = *link;
+    BTNode * child = node->right;
+    node->right = child->left;
+    child->left = node;
+    *link = child;
+
+    update_max_end(node);
+    update_max_end(child);
+}
+
+template < typename PointType, typename ValueType >
+typename IntervalBST< PointType, ValueType >::BTNode * IntervalBST< PointType, ValueType >::clone( const BTNode * root )
+{
+    // Walk down the left spines, setting aside the right subtrees still to copy,
+    // so that the depth of the tree does not weigh on the call stack.
+    BTNode * copy = nullptr;
+    std::vector< std::pair< const BTNode *, BTNode ** > > s;
+    if(root != nullptr)
+    {
+        s.push_back(std::make_pair(root, &copy));
+    }
+
+    try
+    {
+        while(!s.empty())
+        {
+            const BTNode * node = s.back().first;
+            BTNode ** link = s.back().second;
+            s.pop_back();
+
+            while(node != nullptr)
+            {
+                *link = new BTNode(node->key, node->data, node->priority);
+                (*link)->max_end = node->max_end;
+                if(node->right != nullptr)
+                {
+                    s.push_back(std::make_pair(node->right, &(*link)->right));
+                }
+                link = &(*link)->left;
+                node = node->left;
+            }
+        }
+    }
+    catch(...)
+    {
+        free_subtree(copy);
+        throw;
+    }
+
+    return copy;
+}
+
+template < typename PointType, typename ValueType >
+void IntervalBST< PointType, ValueType >::free_subtree( BTNode * root )
+{
+    std::vector< BTNode * > s;
+    if(root != nullptr)
+    {
+        s.push_back(root);
+    }
+
+    while(!s.empty())
+    {
+        BTNode * node = s.back(); s.pop_back();
+        if(node->left != nullptr)
+        {
+            s.push_back(node->left);
+        }
+        if(node->right != nullptr)
+        {
+            s.push_back(node->right);
+        }
+        delete node;
+    }
+}
+
+template < typename PointType, typename ValueType >
+template < typename NodePointer, typename Function >
+void IntervalBST< PointType, ValueType >::overlapping( NodePointer root, const PointType & lo, const PointType & hi, Function & visit ) const
+{
+    std::stack< NodePointer, std::vector< NodePointer > > s;
+
+    while(true)
+    {
+        // Skip the subtrees where every interval ends before lo.
+        while(root != nullptr && !m_point_less(root->max_end, lo))
+        {
+            s.push(root);
+            // The left subtree holds intervals starting no earlier than root: worth exploring only if root starts by hi.
+            root = !m_point_less(hi, root->key.first) ? root->left : nullptr;
+        }
+
+        if(s.empty())
+        {
+            return;
+        }
+
+        root = s.top(); s.pop();
+
+        if(!m_point_less(hi, root->key.first) && !m_point_less(root->key.second, lo))
+        {
+            if(!bst_detail::keep_visiting(visit, root->key, root->data))
+            {
+                return;
+            }
+        }
+
+        root = root->right;
+    }
+}
+
+template < typename PointType, typename ValueType >
+template < typename NodePointer, typename Function >
+void IntervalBST< PointType, ValueType >::inorder( NodePointer root, Function & visit )
+{
+    std::stack< NodePointer, std::vector< NodePointer > > s;
+
+    while(root != nullptr || !s.empty())
+    {
+        while(root != nullptr)
+        {
+            s.push(root);
+            root = root->left;
+        }
+
+        root = s.top(); s.pop();
+
+        if(!bst_detail::keep_visiting(visit, root->key, root->data))
+        {
+            return;
+        }
+
+        root = root->right;
+    }
+}
+
+template < typename PointType, typename ValueType >
+IntervalBST< PointType, ValueType >::IntervalBST( std::initializer_list< node_content_type > init , const PointTypeLess & comp )
+    : m_root( nullptr )
+    , m_n_nodes( 0 )
+    , m_point_less( comp )
+{
+    for(const auto & element: init)
+    {
+        insert(element.first.first, element.first.second, element.second);
+    }
+}
+
+template < typename PointType, typename ValueType >
+IntervalBST< PointType, ValueType >::IntervalBST( const IntervalBST & other )
+    : m_root( clone(other.m_root) )
+    , m_n_nodes( other.m_n_nodes )
+    , m_point_less( other.m_point_less )
+{/* empty */}
+
+template < typename PointType, typename ValueType >
+IntervalBST< PointType, ValueType > & IntervalBST< PointType, ValueType >::operator=( const IntervalBST & rhs )
+{
+    if(this == &rhs)
+    {
+        return *this;
+    }
+
+    BTNode * copy = clone(rhs.m_root);
+    free_subtree(m_root);
+    m_root = copy;
+    m_n_nodes = rhs.m_n_nodes;
+    m_point_less = rhs.m_point_less;
+
+    return *this;
+}
+
+template < typename PointType, typename ValueType >
+IntervalBST< PointType, ValueType >::~IntervalBST()
+{
+    free_subtree(m_root);
+}
+
+template < typename PointType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type IntervalBST< PointType, ValueType >::overlapping( const PointType & lo, const PointType & hi, Function && visit ) const
+{
+    overlapping(static_cast< const BTNode * >( m_root ), lo, hi, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename PointType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type IntervalBST< PointType, ValueType >::overlapping( const PointType & lo, const PointType & hi, Function && visit )
+{
+    overlapping(m_root, lo, hi, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename PointType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type IntervalBST< PointType, ValueType >::stabbing( const PointType & point, Function && visit ) const
+{
+    overlapping(static_cast< const BTNode * >( m_root ), point, point, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename PointType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type IntervalBST< PointType, ValueType >::stabbing( const PointType & point, Function && visit )
+{
+    overlapping(m_root, point, point, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename PointType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type IntervalBST< PointType, ValueType >::inorder( Function && visit ) const
+{
+    inorder(static_cast< const BTNode * >( m_root ), visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename PointType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type IntervalBST< PointType, ValueType >::inorder( Function && visit )
+{
+    inorder(m_root, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename PointType, typename ValueType >
+size_t IntervalBST< PointType, ValueType >::height( void ) const
+{
+    size_t levels = 0;
+    std::vector< std::pair< const BTNode *, size_t > > s;
+    if(m_root != nullptr)
+    {
+        s.push_back(std::make_pair(m_root, 1));
+    }
+
+    while(!s.empty())
+    {
+        auto visited = s.back(); s.pop_back();
+        levels = std::max(levels, visited.second);
+        if(visited.first->left != nullptr)
+        {
+            s.push_back(std::make_pair(visited.first->left, visited.second + 1));
+        }
+        if(visited.first->right != nullptr)
+        {
+            s.push_back(std::make_pair(visited.first->right, visited.second + 1));
+        }
+    }
+
+    return levels;
+}
+
+template < typename PointType, typename ValueType >
+void IntervalBST< PointType, ValueType >::clear( void )
+{
+    free_subtree(m_root);
+    m_root = nullptr;
+    m_n_nodes = 0;
+}
+
+template < typename PointType, typename ValueType >
+void IntervalBST< PointType, ValueType >::insert( const PointType & lo, const PointType & hi, const ValueType & value )
+{
+    if(m_point_less(hi, lo))
+    {
+        throw std::invalid_argument("insert: the interval ends before it starts");
+    }
+
+    interval_type interval(lo, hi);
+    std::vector< BTNode ** > path; // The links to the ancestors of the new node.
+    BTNode ** slot = &m_root;
+
+    // The new interval ends up in every subtree along the way. Equal intervals go right.
+    while(*slot != nullptr)
+    {
+        BTNode * node = *slot;
+        node->max_end = last_of(node->max_end, hi);
+        path.push_back(slot);
+        slot = comes_before(node->key, interval) ? &node->left : &node->right;
+    }
+
+    BTNode * created = new BTNode(interval, value, static_cast< std::uint_fast32_t >( m_priorities() ));
+    *slot = created;
+    m_n_nodes++;
+
+    // Rotate the new node up until its parent has a higher priority.
+    while(!path.empty() && (*path.back())->priority < created->priority)
+    {
+        BTNode ** parent = path.back(); path.pop_back();
+        if((*parent)->left == created)
+        {
+            rotate_right(parent);
+        }
+        else
+        {
+            rotate_left(parent);
+        }
+    }
+}
+
+template < typename PointType, typename ValueType >
+bool IntervalBST< PointType, ValueType >::remove( const PointType & lo, const PointType & hi )
+{
+    interval_type interval(lo, hi);
+    std::vector< BTNode * > path; // The nodes whose largest end point may change.
+    BTNode ** slot = &m_root;
+
+    while(*slot != nullptr)
+    {
+        BTNode * node = *slot;
+        bool node_first = comes_before(node->key, interval);
+        if(!node_first && !comes_before(interval, node->key))
+        {
+            break;
+        }
+        path.push_back(node);
+        slot = node_first ? &node->left : &node->right;
+    }
+
+    if(*slot == nullptr)
+    {
+        return false;
+    }
+
+    // Rotate the target down, lifting its child of higher priority, until it has at most one child.
+    BTNode * target = *slot;
+    while(target->left != nullptr && target->right != nullptr)
+    {
+        if(target->left->priority > target->right->priority)
+        {
+            rotate_right(slot);
+            path.push_back(*slot);
+            slot = &(*slot)->right;
+        }
+        else
+        {
+            rotate_left(slot);
+            path.push_back(*slot);
+            slot = &(*slot)->left;
+        }
+    }
+    *slot = target->left != nullptr ? target->left : target->right;
+
+    delete target;
+    m_n_nodes--;
+
+    // Fix the largest end points bottom-up.
+    for(auto it = path.rbegin(); it != path.rend(); ++it)
+    {
+        update_max_end(*it);
+    }
+
+    return true;
+}
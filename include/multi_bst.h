@@ -0,0 +1,127 @@
+#pragma once
+#include "bst.h"
+
+
+//!  This class implements a generic Binary Search Tree that allows duplicate keys.
+/*!
+  MultiBST is a sorted associative container that stores key-value pairs,
+  where several pairs may share the same key. Each pair is a node of its own,
+  so no per-key container (and no extra allocation) is needed to hold equal keys.
+
+  It offers the whole BST interface, except that insert() and insert_hint() never drop a pair,
+  and that operator[]() and get_or_insert(), which insert only missing keys, are not available;
+  lookups such as find() or retrieve() return one of the values with the requested key.
+  Pairs with equal keys are visited by the traversals in insertion order.
+
+  @tparam KeyType The type of the key associated with the data.
+  @tparam ValueType The type of the data to be stored in the tree.
+*/
+template < typename KeyType, typename ValueType >
+class MultiBST : public BST< KeyType, ValueType >
+{
+    public:
+        //=== alias
+        typedef BST< KeyType, ValueType > base_type; //!< The unique-key tree we build on.
+        typedef typename base_type::KeyTypeLess KeyTypeLess;
+        typedef typename base_type::node_content_type node_content_type;
+
+    protected:
+        typedef typename base_type::BTNode BTNode;
+
+    public:
+        //=== special member
+        //! Default constructor.
+        /*!
+         *  Creates an empty MultiBST.
+         *  @param comp The function object necessary to compare keys.
+         */
+        explicit MultiBST( const KeyTypeLess & comp = KeyTypeLess() )
+            : base_type( comp )
+            {/* empty */}
+
+        //! The range constructor.
+        /*!
+         *  Creates a new tree inserting every key-value element from the range `[first, last)` provided,
+         *  including the ones with keys that compare equivalent.
+         *  @tparam InputItr The input iterator to the range we insert from.
+         *  @param first the begining of the range to copy from.
+         *  @param last the end (exclusive) of the range to copy from.
+         *  @param comp The function object necessary to compare keys.
+         */
+        template < typename InputItr >
+        MultiBST( InputItr first, InputItr last, const KeyTypeLess & comp = KeyTypeLess() );
+
+        //! The intializer list constructor.
+        /*!
+         *  Creates a new tree inserting every key-value element from the initializer list `init` provided,
+         *  including the ones with keys that compare equivalent.
+         *  @param init The initializer list to initialize the elements of the tree with.
+         *  @param comp The function object necessary to compare keys.
+         */
+        MultiBST( std::initializer_list< node_content_type > init , const KeyTypeLess & comp = KeyTypeLess() );
+
+        //! The initializer list assignment operator.
+        /*!
+         *  Same as BST::operator=( std::initializer_list< node_content_type > ),
+         *  except that elements with keys that compare equivalent are all inserted.
+         *  @param ilist The initialize list to use as data source.
+         *  @return `*this` to enable chained assignments.
+         */
+        MultiBST & operator=( std::initializer_list< node_content_type > ilist );
+
+        //=== access members
+        //! Returns the number of pairs with a key equivalent to `key`.
+        /*! Runs in O(h + k), where h is the height of the tree and k the count returned.
+         *  @param key The key we are looking for.
+         *  @return The number of pairs with `key`.
+         */
+        size_t count( const KeyType & key ) const;
+
+        //! Visits, in insertion order, every pair with a key equivalent to `key`.
+        /*! Runs in O(h + k), where h is the height of the tree and k the number of pairs visited.
+         *  @tparam Function A function object of the form `std::function<void( const KeyType &, const ValueType  & )>`
+         *  or `std::function<void( const ValueType  & )>`, optionally returning `bool` to stop early.
+         *  @param key The key we are looking for.
+         *  @param visit The function object to be applied to each pair with `key`.
+         */
+        template < typename Function >
+        typename std::decay< Function >::type equal_range( const KeyType & key, Function && visit ) const ;
+        //! Visits every pair with a key equivalent to `key`, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type equal_range( const KeyType & key, Function && visit );
+
+        //=== MODIFIER MEMBERS
+        //! Inserts a new pair <`key`,`value`> in the tree, even if the key is already stored in the tree.
+        /*! The new pair comes after the pairs with an equivalent key already in the tree.
+         *  @param key The key associated with the value we wish to operate on.
+         *  @param value The value we wish to store in the tree.
+         */
+        void insert( const KeyType & key , const ValueType & value );
+
+        //! Inserts a new pair <`key`,`value`>, starting from the last hinted insertion, even if the key is already stored.
+        /*! Same as BST::insert_hint(), except that the pair is always inserted,
+         *  after the pairs with an equivalent key already in the tree.
+         *  @param key The key associated with the value we wish to operate on.
+         *  @param value The value we wish to store in the tree.
+         */
+        void insert_hint( const KeyType & key , const ValueType & value );
+
+        // Both look a key up, and insert it only if it is missing: meaningless with duplicate keys.
+        ValueType & operator[]( const KeyType & key ) = delete;
+        ValueType & get_or_insert( const KeyType & key, const ValueType & value ) = delete;
+
+        //! Removes from the tree one of the pairs with a key equivalent to `key`.
+        /*! @param key The key we wish to remove.
+         *  @return true if a pair has been removed, false if the key is not in the tree.
+         */
+        bool erase_one( const KeyType & key );
+
+        //! Removes from the tree every pair with a key equivalent to `key`.
+        /*! Runs in O(h + k), where h is the height of the tree and k the number of pairs removed.
+         *  @param key The key we wish to remove.
+         *  @return The number of pairs removed.
+         */
+        size_t erase_all( const KeyType & key );
+};
+
+#include "multi_bst.inl"
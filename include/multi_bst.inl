@@ -0,0 +1,105 @@
+#include "multi_bst.h"
+
+template < typename KeyType, typename ValueType >
+template < typename InputItr >
+MultiBST< KeyType, ValueType >::MultiBST( InputItr first, InputItr last, const KeyTypeLess & comp )
+    : base_type( comp )
+{
+    for(auto it=first; it!= last; it++)
+    {
+        insert((*it).first, (*it).second);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+MultiBST< KeyType, ValueType >::MultiBST( std::initializer_list< node_content_type > init , const KeyTypeLess & comp )
+    : base_type( comp )
+{
+    for(const auto & element: init)
+    {
+        insert(element.first, element.second);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+MultiBST< KeyType, ValueType > & MultiBST< KeyType, ValueType >::operator=( std::initializer_list< node_content_type > ilist )
+{
+    this->clear();
+    for(const auto & element: ilist)
+    {
+        insert(element.first, element.second);
+    }
+
+    return *this;
+}
+
+template < typename KeyType, typename ValueType >
+size_t MultiBST< KeyType, ValueType >::count( const KeyType & key ) const
+{
+    size_t n_found = 0;
+    this->for_each_in_range(key, key, [&]( const ValueType & ) { n_found++; });
+
+    return n_found;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type MultiBST< KeyType, ValueType >::equal_range( const KeyType & key, Function && visit ) const
+{
+    this->for_each_in_range(key, key, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type MultiBST< KeyType, ValueType >::equal_range( const KeyType & key, Function && visit )
+{
+    this->for_each_in_range(key, key, visit);
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+void MultiBST< KeyType, ValueType >::insert( const KeyType & key , const ValueType & value )
+{
+    // Equivalent keys go to the right subtree, which the inorder traversal visits last.
+    BTNode ** slot = &this->m_root;
+    size_t depth = 1;
+
+    while(*slot != nullptr)
+    {
+        slot = this->m_key_less((*slot)->key, key) ? &(*slot)->left : &(*slot)->right;
+        depth++;
+    }
+
+    *slot = this->create_node(key, value);
+    this->m_n_nodes++;
+    this->note_insertion(*slot, depth);
+}
+
+template < typename KeyType, typename ValueType >
+void MultiBST< KeyType, ValueType >::insert_hint( const KeyType & key , const ValueType & value )
+{
+    this->insert_near_finger(key, value, true);
+}
+
+template < typename KeyType, typename ValueType >
+bool MultiBST< KeyType, ValueType >::erase_one( const KeyType & key )
+{
+    BTNode * & slot = this->find_slot(this->m_root, key, this->m_key_less);
+
+    if(slot == nullptr)
+    {
+        this->rebalance_some();
+        return false;
+    }
+
+    this->unlink(slot);
+    this->rebalance_some();
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+size_t MultiBST< KeyType, ValueType >::erase_all( const KeyType & key )
+{
+    return this->erase_range(key, key);
+}
@@ -0,0 +1,268 @@
+#pragma once
+#include <functional> // std::function, std::hash
+#include <algorithm>  // std::upper_bound, std::max, std::sort
+#include <utility>    // std::pair<>, std::forward
+#include <stdexcept>  // std::invalid_argument, std::logic_error
+#include <vector>     // std::vector
+#include <queue>      // std::queue
+#include <memory>     // std::unique_ptr, std::shared_ptr, std::atomic_load_explicit
+#include <mutex>      // std::mutex, std::unique_lock, std::lock_guard
+#include <atomic>     // std::memory_order
+#include <type_traits> // std::decay
+
+#include "bst.h"
+#include "visitor.h"
+
+
+//!  This class implements a thread-safe container that spreads its keys over several BSTs.
+/*!
+  ShardedBST partitions the key space across N independent BST *shards*. Each shard has
+  its own lock and, being a BST, its own node storage, so that threads working on keys of
+  different shards never wait for one another, nor share an allocator.
+
+  Keys are assigned to shards either by hash (Partitioning::HASH), which spreads any
+  workload evenly, or by range (Partitioning::RANGE), where the shard boundaries are
+  keys given by the client. Only the latter keeps each shard a contiguous slice of the
+  key order, and therefore supports ordered traversals across shards.
+
+  The number of shards and the partitioning can be changed at any time by reshard(),
+  while other threads keep using the container. The keys move one old shard at a time:
+  a thread only waits if it needs the shard being moved, and looks up the keys of the
+  shards already moved in the new ones.
+
+  Every member may be called from several threads at the same time.
+  The comparator and the hash function must be safe to call concurrently as well.
+
+  @tparam KeyType The type of the key associated with the data.
+  @tparam ValueType The type of the data to be stored in the tree.
+*/
+template < typename KeyType, typename ValueType >
+class ShardedBST
+{
+    public:
+        //=== alias
+        typedef BST< KeyType, ValueType > shard_type; //!< The tree each shard holds.
+        typedef typename shard_type::KeyTypeLess KeyTypeLess;
+        typedef typename shard_type::KeyTypeHash KeyTypeHash;
+        typedef typename shard_type::node_content_type node_content_type;
+
+        //! How keys are assigned to shards.
+        enum class Partitioning {
+            HASH, //!< By hash of the key, modulo the number of shards.
+            RANGE //!< By ranges of keys, delimited by client-provided boundaries.
+        };
+
+    private:
+        //! A shard: a tree and the lock that guards it.
+        struct Shard {
+            std::mutex lock; //!< Guards the tree and the `moved` flag.
+            shard_type tree; //!< The keys assigned to this shard.
+            bool moved; //!< Whether the keys of this shard now live in the next layout.
+
+            //! Creates an empty shard.
+            explicit Shard( const KeyTypeLess & comp )
+                : tree( comp )
+                , moved( false )
+                { /* empty */ }
+        };
+
+        //! The assignment of keys to shards, and the shards themselves.
+        /*! reshard() links a new layout as the `next` one, then moves the keys of each old
+         *  shard into it, holding only the lock of that shard (and, briefly, of the new shards
+         *  receiving them), and finally publishes the new layout.
+         *  A thread that finds its shard moved goes on with the next layout, so a key lives in
+         *  exactly one unmoved shard of the chain of layouts at any time.
+         *  Every thread holds its own reference to the layout it works on, so an old layout is
+         *  freed as soon as the last of them lets go of it.
+         */
+        struct Layout {
+            Partitioning partitioning; //!< How keys are assigned to shards.
+            std::vector< KeyType > boundaries; //!< With Partitioning::RANGE: the first key of each shard but the first one.
+            std::vector< std::unique_ptr< Shard > > shards; //!< The shards.
+            std::shared_ptr< Layout > next; //!< The layout the keys are moving to, if any; only accessed through `std::atomic_load/store`.
+        };
+
+        //! The layouts that may hold keys, from the current one to the newest one.
+        typedef std::vector< std::shared_ptr< Layout > > layout_chain;
+
+        std::shared_ptr< Layout > m_layout; //!< The current layout; only accessed through `std::atomic_load/store`.
+        std::mutex m_reshard_lock; //!< Serializes calls to reshard().
+        KeyTypeLess m_key_less; //!< The key comparator function object.
+        KeyTypeHash m_hash; //!< The hash function of Partitioning::HASH.
+
+
+        //=== INTERNAL MEMBERS
+
+        //! Returns the index of the shard of a layout that `key` is assigned to.
+        size_t shard_index( const Layout & layout, const KeyType & key ) const;
+
+        //! Applies `operation` to the tree of the shard `key` is assigned to, holding the shard lock.
+        /*! @tparam Operation A function object of the form `std::function<R( shard_type & )>`.
+         *  @return Whatever `operation` returns.
+         */
+        template < typename Operation >
+        auto with_shard( const KeyType & key, const Operation & operation ) const
+            -> decltype( operation( std::declval< shard_type & >() ) );
+
+        //! Locks every shard of the current layout and of the layouts it is moving to, oldest first.
+        /*! No key can move while the locks are held.
+         *  @param layouts Receives the layouts; it must outlive `locks`, since the layouts own the mutexes.
+         *  @param locks Receives the locks.
+         */
+        void lock_all( layout_chain & layouts, std::vector< std::unique_lock< std::mutex > > & locks ) const;
+
+        //! Returns the newest layout, the one keys are moving to if a reshard() is under way.
+        std::shared_ptr< Layout > newest_layout( void ) const;
+
+        //! Creates a layout with empty shards.
+        std::unique_ptr< Layout > make_layout( Partitioning partitioning, size_t n_shards,
+                                               const std::vector< KeyType > & boundaries ) const;
+
+        //! Moves the keys of every shard of `from` into the shards of `from.next`, one shard at a time.
+        /*! If an exception interrupts the move of a shard, the keys of that shard already copied
+         *  are taken back, and the shard keeps its keys.
+         */
+        void move_keys( Layout & from ) const;
+
+        //! Replaces the current layout with a new one holding the same pairs.
+        void switch_layout( Partitioning partitioning, size_t n_shards, const std::vector< KeyType > & boundaries );
+
+        //! Visits in **inorder** the pairs of several layouts, which happens while a reshard() is under way.
+        /*! The shards of different layouts overlap in the key order, so the pairs are gathered and sorted first.
+         *  @tparam Value Either `ValueType` or `const ValueType`.
+         *  @param lo,hi The range of keys to visit, or `nullptr` to visit every key.
+         */
+        template < typename Value, typename Function >
+        void merged_inorder( const layout_chain & layouts, const KeyType * lo, const KeyType * hi, Function & visit ) const;
+
+        //! Checks that the range boundaries are in strictly increasing order.
+        /*! @throw std::invalid_argument if they are not.
+         */
+        void check_boundaries( const std::vector< KeyType > & boundaries ) const;
+
+        //! Wraps a visitor so that the traversals of the shards can tell when it asks to stop.
+        template < typename Function >
+        struct StopAware {
+            Function & visit; //!< The client visitor.
+            bool & stopped; //!< Set when the visitor asks to stop.
+
+            //! Visits a pair, returning false once the client visitor asked to stop.
+            template < typename Value >
+            bool operator()( const KeyType & key, Value & value ) const
+            {
+                stopped = !bst_detail::keep_visiting(visit, key, value);
+                return !stopped;
+            }
+        };
+
+    public:
+        //=== special member
+        //! Creates an empty container whose keys are assigned to shards by hash.
+        /*!
+         *  @param n_shards The number of shards; at least one is created.
+         *  @param comp The function object necessary to compare keys.
+         *  @param hash The hash function that assigns keys to shards.
+         */
+        ShardedBST( size_t n_shards, const KeyTypeLess & comp, const KeyTypeHash & hash = std::hash< KeyType >() );
+
+        //! Creates an empty container whose keys are assigned to shards by range.
+        /*!
+         *  With boundaries `b_1, ..., b_{N-1}`, the first shard holds the keys before `b_1`,
+         *  the i-th shard the keys from `b_{i-1}` up to (not including) `b_i`, and the last
+         *  shard the keys from `b_{N-1}` on, all in the order induced by `comp`.
+         *  @param boundaries The first key of each shard but the first one, in increasing order.
+         *  @param comp The function object necessary to compare keys.
+         *  @param hash The hash function used if the container is resharded by hash later on.
+         *  @throw std::invalid_argument if the boundaries are not in increasing order.
+         */
+        ShardedBST( const std::vector< KeyType > & boundaries, const KeyTypeLess & comp,
+                    const KeyTypeHash & hash = std::hash< KeyType >() );
+
+        // Shards hold locks, which cannot be copied.
+        ShardedBST( const ShardedBST & ) = delete;
+        ShardedBST & operator=( const ShardedBST & ) = delete;
+
+        //=== access members
+        //! Returns how keys are currently assigned to shards (or will be, once a reshard() under way ends).
+        Partitioning partitioning( void ) const;
+        //! Returns the current number of shards (or the new one, while a reshard() is under way).
+        size_t n_shards( void ) const;
+
+        //! Checks whether the container holds a given key.
+        bool contains( const KeyType & key ) const;
+
+        //! Retrieves in `value` a copy of the value associated with the provided key.
+        /*! @return true if key is found and the value copied into `value`, false otherwise.
+         */
+        bool retrieve( const KeyType & key, ValueType & value ) const;
+
+        //! Returns the number of key-value elements stored in all the shards.
+        /*! The count is exact if no other thread modifies the container meanwhile.
+         */
+        size_t size( void ) const;
+        //! Returns true if no shard holds any element.
+        bool empty( void ) const;
+
+        //=== traversal members
+        // The traversals lock every shard for their whole duration, so they see a
+        // consistent state of the container. Their visitor must not call the container.
+        // While a reshard() is under way, the shards of both layouts are locked, and the
+        // ordered traversals sort the pairs they gather before visiting them.
+        // Same visitor protocol as the BST traversals.
+
+        //! Visits every pair, shard by shard, in no particular order across shards.
+        template < typename Function >
+        typename std::decay< Function >::type for_each( Function && visit ) const;
+        //! Visits every pair, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type for_each( Function && visit );
+
+        //! Visits every pair in **inorder**, that is in the same order as BST::inorder().
+        /*! The shards are traversed one after the other, which merges their contents
+         *  in order since each one holds a slice of the key range.
+         *  @throw std::logic_error unless keys are assigned to shards by range.
+         */
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit ) const;
+        //! Visits every pair in **inorder**, allowing the visitor to modify the values.
+        template < typename Function >
+        typename std::decay< Function >::type inorder( Function && visit );
+
+        //! Visits the pairs whose keys lie in the range `[lo, hi]`.
+        /*! With Partitioning::RANGE, only the shards that may hold keys of the range are
+         *  traversed, and the pairs are visited in **inorder**; with Partitioning::HASH,
+         *  each shard is searched, and the order across shards is unspecified.
+         */
+        template < typename Function >
+        typename std::decay< Function >::type for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit ) const;
+
+        //=== MODIFIER MEMBERS
+        //! Inserts a new pair <`key`,`value`> in its shard, if the key is not already stored.
+        void insert( const KeyType & key, const ValueType & value );
+
+        //! Removes the node containing the requested key from its shard, if one is found.
+        void remove( const KeyType & key );
+
+        //! Removes all the elements from every shard.
+        void clear( void );
+
+        //! Moves every element into `n_shards` new shards, assigned by hash.
+        /*! Other threads may keep using the container. The old shards are moved one at a time,
+         *  so a thread only waits while the shard it needs is being moved, and a traversal while
+         *  the current shard is moved. Only the keys of one old shard are held twice at any time.
+         *  The keys of each old shard enter the new shards middle first, to keep them balanced.
+         *  Should an exception interrupt the move, every key stays reachable, and the next
+         *  call completes the interrupted move first.
+         *  @param n_shards The new number of shards; at least one is created.
+         */
+        void reshard( size_t n_shards );
+
+        //! Moves every element into new shards, assigned by range.
+        /*! @param boundaries The first key of each shard but the first one, in increasing order.
+         *  @throw std::invalid_argument if the boundaries are not in increasing order.
+         *  @see reshard( size_t )
+         */
+        void reshard( const std::vector< KeyType > & boundaries );
+};
+
+#include "sharded_bst.inl"
@@ -0,0 +1,485 @@
+#include "sharded_bst.h"
+
+template < typename KeyType, typename ValueType >
+size_t ShardedBST< KeyType, ValueType >::shard_index( const Layout & layout, const KeyType & key ) const
+{
+    if(layout.partitioning == Partitioning::HASH)
+    {
+        return m_hash(key) % layout.shards.size();
+    }
+
+    // The shard of a key is the number of boundaries that do not come after it.
+    auto after_key = std::upper_bound(layout.boundaries.begin(), layout.boundaries.end(), key,
+                                      [this]( const KeyType & a, const KeyType & b ) { return m_key_less(a, b); });
+    return after_key - layout.boundaries.begin();
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Operation >
+auto ShardedBST< KeyType, ValueType >::with_shard( const KeyType & key, const Operation & operation ) const
+    -> decltype( operation( std::declval< shard_type & >() ) )
+{
+    std::shared_ptr< Layout > layout = std::atomic_load_explicit(&m_layout, std::memory_order_acquire);
+    while(true)
+    {
+        Shard & shard = *layout->shards[shard_index(*layout, key)];
+        std::shared_ptr< Layout > next;
+        {
+            std::lock_guard< std::mutex > guard(shard.lock);
+            if(!shard.moved)
+            {
+                return operation(shard.tree);
+            }
+            // A reshard() moved the key to the next layout.
+            next = std::atomic_load_explicit(&layout->next, std::memory_order_acquire);
+        }
+        // Unlock the shard before letting go of its layout: it may be the last reference.
+        layout = std::move(next);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::lock_all( layout_chain & layouts, std::vector< std::unique_lock< std::mutex > > & locks ) const
+{
+    std::shared_ptr< Layout > layout = std::atomic_load_explicit(&m_layout, std::memory_order_acquire);
+    while(layout != nullptr)
+    {
+        // Older layouts first, and the shards of a layout in order, so that two threads
+        // locking every shard cannot deadlock, nor deadlock with a reshard().
+        for(const auto & shard : layout->shards)
+        {
+            locks.emplace_back(shard->lock);
+        }
+        layouts.push_back(layout);
+
+        // Set before any of the shards just locked could be moved.
+        layout = std::atomic_load_explicit(&layout->next, std::memory_order_acquire);
+    }
+}
+
+template < typename KeyType, typename ValueType >
+std::shared_ptr< typename ShardedBST< KeyType, ValueType >::Layout >
+ShardedBST< KeyType, ValueType >::newest_layout( void ) const
+{
+    std::shared_ptr< Layout > layout = std::atomic_load_explicit(&m_layout, std::memory_order_acquire);
+    std::shared_ptr< Layout > next;
+    while((next = std::atomic_load_explicit(&layout->next, std::memory_order_acquire)) != nullptr)
+    {
+        layout = std::move(next);
+    }
+
+    return layout;
+}
+
+template < typename KeyType, typename ValueType >
+std::unique_ptr< typename ShardedBST< KeyType, ValueType >::Layout >
+ShardedBST< KeyType, ValueType >::make_layout( Partitioning partitioning, size_t n_shards,
+                                               const std::vector< KeyType > & boundaries ) const
+{
+    std::unique_ptr< Layout > layout(new Layout);
+    layout->partitioning = partitioning;
+    layout->boundaries = boundaries;
+
+    n_shards = partitioning == Partitioning::RANGE ? boundaries.size() + 1 : std::max< size_t >(n_shards, 1);
+    layout->shards.reserve(n_shards);
+    for(size_t i = 0; i < n_shards; ++i)
+    {
+        layout->shards.emplace_back(new Shard(m_key_less));
+    }
+
+    return layout;
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::move_keys( Layout & from ) const
+{
+    Layout & to = *std::atomic_load_explicit(&from.next, std::memory_order_acquire);
+
+    for(const auto & shard : from.shards)
+    {
+        std::lock_guard< std::mutex > guard(shard->lock);
+        if(shard->moved)
+        {
+            continue;
+        }
+
+        // (1) Sort out the pairs of the shard by new shard, each bucket in inorder.
+        std::vector< std::vector< node_content_type > > buckets(to.shards.size());
+        shard->tree.inorder([&]( const KeyType & key, const ValueType & value )
+                            { buckets[shard_index(to, key)].push_back(node_content_type(key, value)); });
+
+        // (2) Insert each bucket middle first, so that a sorted bucket does not build a vine.
+        //     No other thread touches these keys in the new shards until the shard is marked as moved.
+        size_t n_filled = 0;
+        try
+        {
+            for(; n_filled < buckets.size(); ++n_filled)
+            {
+                const auto & bucket = buckets[n_filled];
+                std::lock_guard< std::mutex > target_guard(to.shards[n_filled]->lock);
+                std::queue< std::pair< size_t, size_t > > halves;
+                halves.push(std::make_pair(size_t(0), bucket.size()));
+                while(!halves.empty())
+                {
+                    auto half = halves.front(); halves.pop();
+                    if(half.first == half.second)
+                    {
+                        continue;
+                    }
+                    size_t middle = half.first + ( half.second - half.first ) / 2;
+                    to.shards[n_filled]->tree.insert(bucket[middle].first, bucket[middle].second);
+                    halves.push(std::make_pair(half.first, middle));
+                    halves.push(std::make_pair(middle + 1, half.second));
+                }
+            }
+        }
+        catch(...)
+        {
+            // Take back the keys copied so far: until the shard is moved, they belong to it.
+            for(size_t i = 0; i <= n_filled && i < buckets.size(); ++i)
+            {
+                std::lock_guard< std::mutex > target_guard(to.shards[i]->lock);
+                for(const auto & pair : buckets[i])
+                {
+                    to.shards[i]->tree.remove(pair.first);
+                }
+            }
+            throw;
+        }
+
+        // (3) From now on the keys of the shard are looked up in the new layout.
+        shard->tree.clear();
+        shard->moved = true;
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::switch_layout( Partitioning partitioning, size_t n_shards, const std::vector< KeyType > & boundaries )
+{
+    std::lock_guard< std::mutex > resharding(m_reshard_lock);
+    std::shared_ptr< Layout > old_layout = std::atomic_load_explicit(&m_layout, std::memory_order_acquire);
+
+    // Complete the move an exception interrupted, if any.
+    std::shared_ptr< Layout > new_layout = std::atomic_load_explicit(&old_layout->next, std::memory_order_acquire);
+    if(new_layout != nullptr)
+    {
+        move_keys(*old_layout);
+        std::atomic_store_explicit(&m_layout, new_layout, std::memory_order_release);
+        old_layout = new_layout;
+    }
+
+    new_layout = make_layout(partitioning, n_shards, boundaries);
+    std::atomic_store_explicit(&old_layout->next, new_layout, std::memory_order_release);
+    move_keys(*old_layout);
+    std::atomic_store_explicit(&m_layout, new_layout, std::memory_order_release);
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Value, typename Function >
+void ShardedBST< KeyType, ValueType >::merged_inorder( const layout_chain & layouts, const KeyType * lo, const KeyType * hi, Function & visit ) const
+{
+    typedef typename std::conditional< std::is_const< Value >::value, const shard_type, shard_type >::type tree_type;
+    typedef std::pair< const KeyType *, Value * > entry_type;
+
+    std::vector< entry_type > entries;
+    auto gather = [&entries]( const KeyType & key, Value & value ) { entries.push_back(entry_type(&key, &value)); };
+    for(const auto & layout : layouts)
+    {
+        for(const auto & shard : layout->shards)
+        {
+            tree_type & tree = shard->tree;
+            if(lo != nullptr)
+            {
+                tree.for_each_in_range(*lo, *hi, gather);
+            }
+            else
+            {
+                tree.inorder(gather);
+            }
+        }
+    }
+
+    // BST::inorder() visits the keys that come last first.
+    std::sort(entries.begin(), entries.end(), [this]( const entry_type & a, const entry_type & b )
+              { return m_key_less(*b.first, *a.first); });
+    for(const auto & entry : entries)
+    {
+        if(!bst_detail::keep_visiting(visit, *entry.first, *entry.second))
+        {
+            return;
+        }
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::check_boundaries( const std::vector< KeyType > & boundaries ) const
+{
+    for(size_t i = 1; i < boundaries.size(); ++i)
+    {
+        if(!m_key_less(boundaries[i-1], boundaries[i]))
+        {
+            throw std::invalid_argument("ShardedBST: the shard boundaries are not in increasing order");
+        }
+    }
+}
+
+template < typename KeyType, typename ValueType >
+ShardedBST< KeyType, ValueType >::ShardedBST( size_t n_shards, const KeyTypeLess & comp, const KeyTypeHash & hash )
+    : m_key_less( comp )
+    , m_hash( hash )
+{
+    m_layout = make_layout(Partitioning::HASH, n_shards, std::vector< KeyType >());
+}
+
+template < typename KeyType, typename ValueType >
+ShardedBST< KeyType, ValueType >::ShardedBST( const std::vector< KeyType > & boundaries, const KeyTypeLess & comp, const KeyTypeHash & hash )
+    : m_key_less( comp )
+    , m_hash( hash )
+{
+    check_boundaries(boundaries);
+    m_layout = make_layout(Partitioning::RANGE, 0, boundaries);
+}
+
+template < typename KeyType, typename ValueType >
+typename ShardedBST< KeyType, ValueType >::Partitioning ShardedBST< KeyType, ValueType >::partitioning( void ) const
+{
+    // A layout is never modified once published, but for its link, its trees and their flags.
+    return newest_layout()->partitioning;
+}
+
+template < typename KeyType, typename ValueType >
+size_t ShardedBST< KeyType, ValueType >::n_shards( void ) const
+{
+    return newest_layout()->shards.size();
+}
+
+template < typename KeyType, typename ValueType >
+bool ShardedBST< KeyType, ValueType >::contains( const KeyType & key ) const
+{
+    return with_shard(key, [&key]( shard_type & tree ) { return tree.contains(key); });
+}
+
+template < typename KeyType, typename ValueType >
+bool ShardedBST< KeyType, ValueType >::retrieve( const KeyType & key, ValueType & value ) const
+{
+    return with_shard(key, [&]( shard_type & tree ) { return tree.retrieve(key, value); });
+}
+
+template < typename KeyType, typename ValueType >
+size_t ShardedBST< KeyType, ValueType >::size( void ) const
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+
+    // The shards already moved are empty.
+    size_t n_pairs = 0;
+    for(const auto & layout : layouts)
+    {
+        for(const auto & shard : layout->shards)
+        {
+            n_pairs += shard->tree.size();
+        }
+    }
+
+    return n_pairs;
+}
+
+template < typename KeyType, typename ValueType >
+bool ShardedBST< KeyType, ValueType >::empty( void ) const
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+
+    for(const auto & layout : layouts)
+    {
+        for(const auto & shard : layout->shards)
+        {
+            if(!shard->tree.empty())
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type ShardedBST< KeyType, ValueType >::for_each( Function && visit ) const
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+
+    bool stopped = false;
+    StopAware< typename std::remove_reference< Function >::type > visit_shard{ visit, stopped };
+    for(const auto & layout : layouts)
+    {
+        for(size_t i = 0; i < layout->shards.size() && !stopped; ++i)
+        {
+            static_cast< const shard_type & >( layout->shards[i]->tree ).inorder(visit_shard);
+        }
+    }
+
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type ShardedBST< KeyType, ValueType >::for_each( Function && visit )
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+
+    bool stopped = false;
+    StopAware< typename std::remove_reference< Function >::type > visit_shard{ visit, stopped };
+    for(const auto & layout : layouts)
+    {
+        for(size_t i = 0; i < layout->shards.size() && !stopped; ++i)
+        {
+            layout->shards[i]->tree.inorder(visit_shard);
+        }
+    }
+
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type ShardedBST< KeyType, ValueType >::inorder( Function && visit ) const
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+    if(layouts.back()->partitioning != Partitioning::RANGE)
+    {
+        throw std::logic_error("ShardedBST::inorder: keys are not partitioned by range");
+    }
+    if(layouts.size() > 1)
+    {
+        merged_inorder< const ValueType >(layouts, nullptr, nullptr, visit);
+        return std::forward< Function >( visit );
+    }
+
+    // BST::inorder() visits the keys that come last first, so go through the shards backwards too.
+    const Layout * layout = layouts.front().get();
+    bool stopped = false;
+    StopAware< typename std::remove_reference< Function >::type > visit_shard{ visit, stopped };
+    for(size_t i = layout->shards.size(); i > 0 && !stopped; --i)
+    {
+        static_cast< const shard_type & >( layout->shards[i-1]->tree ).inorder(visit_shard);
+    }
+
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type ShardedBST< KeyType, ValueType >::inorder( Function && visit )
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+    if(layouts.back()->partitioning != Partitioning::RANGE)
+    {
+        throw std::logic_error("ShardedBST::inorder: keys are not partitioned by range");
+    }
+    if(layouts.size() > 1)
+    {
+        merged_inorder< ValueType >(layouts, nullptr, nullptr, visit);
+        return std::forward< Function >( visit );
+    }
+
+    const Layout * layout = layouts.front().get();
+    bool stopped = false;
+    StopAware< typename std::remove_reference< Function >::type > visit_shard{ visit, stopped };
+    for(size_t i = layout->shards.size(); i > 0 && !stopped; --i)
+    {
+        layout->shards[i-1]->tree.inorder(visit_shard);
+    }
+
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+template < typename Function >
+typename std::decay< Function >::type ShardedBST< KeyType, ValueType >::for_each_in_range( const KeyType & lo, const KeyType & hi, Function && visit ) const
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+
+    if(layouts.size() > 1)
+    {
+        merged_inorder< const ValueType >(layouts, &lo, &hi, visit);
+        return std::forward< Function >( visit );
+    }
+
+    // With range partitioning, only the shards from that of hi down to that of lo may hold keys in range.
+    const Layout * layout = layouts.front().get();
+    size_t last = layout->shards.size();
+    size_t first = 0;
+    if(layout->partitioning == Partitioning::RANGE)
+    {
+        if(m_key_less(hi, lo))
+        {
+            return std::forward< Function >( visit );
+        }
+        last = shard_index(*layout, hi) + 1;
+        first = shard_index(*layout, lo);
+    }
+
+    bool stopped = false;
+    StopAware< typename std::remove_reference< Function >::type > visit_shard{ visit, stopped };
+    for(size_t i = last; i > first && !stopped; --i)
+    {
+        static_cast< const shard_type & >( layout->shards[i-1]->tree ).for_each_in_range(lo, hi, visit_shard);
+    }
+
+    return std::forward< Function >( visit );
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::insert( const KeyType & key, const ValueType & value )
+{
+    with_shard(key, [&]( shard_type & tree ) { tree.insert(key, value); });
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::remove( const KeyType & key )
+{
+    with_shard(key, [&key]( shard_type & tree ) { tree.remove(key); });
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::clear( void )
+{
+    layout_chain layouts;
+    std::vector< std::unique_lock< std::mutex > > locks;
+    lock_all(layouts, locks);
+
+    for(const auto & layout : layouts)
+    {
+        for(const auto & shard : layout->shards)
+        {
+            shard->tree.clear();
+        }
+    }
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::reshard( size_t n_shards )
+{
+    switch_layout(Partitioning::HASH, n_shards, std::vector< KeyType >());
+}
+
+template < typename KeyType, typename ValueType >
+void ShardedBST< KeyType, ValueType >::reshard( const std::vector< KeyType > & boundaries )
+{
+    check_boundaries(boundaries);
+    switch_layout(Partitioning::RANGE, 0, boundaries);
+}
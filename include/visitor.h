@@ -0,0 +1,89 @@
+#pragma once
+#include <type_traits> // std::is_void, std::true_type, std::false_type
+#include <cstddef>     // size_t
+
+
+//! Implementation details shared by the trees of this library; not meant for clients.
+namespace bst_detail {
+
+    //! Calls a key-value visitor; preferred over the value-only form whenever both are viable.
+    template < typename Function, typename Key, typename Value >
+    auto call_visitor( Function & visit, const Key & key, Value & value, int )
+        -> decltype( visit( key, value ) )
+    {
+        return visit(key, value);
+    }
+
+    //! Calls a visitor that only takes the value field.
+    template < typename Function, typename Key, typename Value >
+    auto call_visitor( Function & visit, const Key &, Value & value, long )
+        -> decltype( visit( value ) )
+    {
+        return visit(value);
+    }
+
+    //! Overload of keep_visiting() for visitors that return `void`.
+    template < typename Function, typename Key, typename Value >
+    bool keep_visiting( Function & visit, const Key & key, Value & value, std::true_type )
+    {
+        call_visitor(visit, key, value, 0);
+        return true;
+    }
+
+    //! Overload of keep_visiting() for visitors that return a stop/continue flag.
+    template < typename Function, typename Key, typename Value >
+    bool keep_visiting( Function & visit, const Key & key, Value & value, std::false_type )
+    {
+        return static_cast< bool >( call_visitor(visit, key, value, 0) );
+    }
+
+    //! Applies `visit` to a key-value pair and tells whether the traversal should go on.
+    /*! A visitor may either take the pair `( const Key &, Value & )` or only the value
+     *  field `( Value & )`; the value is `const` when the traversal is.
+     *  Visitors returning `void` never stop a traversal; visitors returning
+     *  something convertible to `bool` stop it by returning `false`.
+     *  @param visit The visitor.
+     *  @param key The key of the pair to be visited.
+     *  @param value The value of the pair to be visited.
+     *  @return true if the traversal should continue, false otherwise.
+     */
+    template < typename Function, typename Key, typename Value >
+    bool keep_visiting( Function & visit, const Key & key, Value & value )
+    {
+        return keep_visiting(visit, key, value, std::is_void< decltype( call_visitor(visit, key, value, 0) ) >());
+    }
+
+    //! Overload of keep_visiting_chunk() for visitors that return `void`.
+    template < typename Function, typename ValuePointer >
+    bool keep_visiting_chunk( Function & visit, ValuePointer * values, size_t n, std::true_type )
+    {
+        visit(static_cast< ValuePointer const * >( values ), n);
+        return true;
+    }
+
+    //! Overload of keep_visiting_chunk() for visitors that return a stop/continue flag.
+    template < typename Function, typename ValuePointer >
+    bool keep_visiting_chunk( Function & visit, ValuePointer * values, size_t n, std::false_type )
+    {
+        return static_cast< bool >( visit(static_cast< ValuePointer const * >( values ), n) );
+    }
+
+    //! Applies a chunk visitor to `n` values and tells whether the traversal should go on.
+    /*! The visitor takes `( ValuePointer const * values, size_t n )`, and follows the same
+     *  stop/continue convention as keep_visiting().
+     */
+    template < typename Function, typename ValuePointer >
+    bool keep_visiting_chunk( Function & visit, ValuePointer * values, size_t n )
+    {
+        return keep_visiting_chunk(visit, values, n, std::is_void< decltype( visit(static_cast< ValuePointer const * >( values ), n) ) >());
+    }
+
+    //! Tells whether a comparator declares the `is_transparent` member type.
+    template < typename Compare, typename = void >
+    struct is_transparent : std::false_type { };
+    //! Specialization for comparators that do declare `is_transparent`.
+    template < typename Compare >
+    struct is_transparent< Compare, typename std::conditional< true, void, typename Compare::is_transparent >::type >
+        : std::true_type { };
+
+} // namespace bst_detail
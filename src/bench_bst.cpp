@@ -0,0 +1,289 @@
+#include <iostream>   // cout, endl
+#include <iomanip>    // std::setw()
+#include <random>     // mt19937, std::shuffle
+#include <vector>
+#include <algorithm>
+#include <numeric>    // std::iota, std::partial_sum
+#include <chrono>     // std::chrono::steady_clock
+#include <cmath>      // std::pow
+#include <cstdlib>    // std::atol
+#include <thread>     // std::thread, std::thread::hardware_concurrency
+#include <mutex>      // std::mutex, std::lock_guard
+#include <functional> // std::function
+
+#include "../include/bst.h"
+#include "../include/sharded_bst.h"
+
+typedef BST< size_t, size_t > tree_type;
+
+//! Runs `work` once and returns the elapsed time, in nanoseconds, per operation.
+template < typename Work >
+double ns_per_op( size_t n_ops, const Work & work )
+{
+    auto start = std::chrono::steady_clock::now();
+    work();
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration< double, std::nano >( stop - start ).count() / n_ops;
+}
+
+//! Prints a line of the report.
+void report( const std::string & label, double ns )
+{
+    std::cout << "  " << std::left << std::setw(40) << label << std::right
+              << std::fixed << std::setprecision(1) << std::setw(10) << ns << " ns/op\n";
+}
+
+//! Builds a tree with the keys `0, ..., n-1` inserted in random order.
+void fill( tree_type & tree, size_t n, std::mt19937 & gen )
+{
+    std::vector< size_t > keys( n );
+    std::iota( keys.begin(), keys.end(), 0 );
+    std::shuffle( keys.begin(), keys.end(), gen );
+
+    for( const auto & k : keys )
+        tree.insert( k, k );
+}
+
+//! Generates `n_lookups` keys in `[0, n)` following a Zipf distribution of exponent `s`.
+/*! The most popular keys are scattered at random over the key space,
+ *  so they are not necessarily near the root of a randomly built tree.
+ */
+std::vector< size_t > zipf_trace( size_t n, size_t n_lookups, double s, std::mt19937 & gen )
+{
+    std::vector< double > cdf( n );
+    for( size_t rank = 0 ; rank < n ; ++rank )
+        cdf[ rank ] = 1.0 / std::pow( rank + 1.0, s );
+    std::partial_sum( cdf.begin(), cdf.end(), cdf.begin() );
+
+    std::vector< size_t > key_of_rank( n );
+    std::iota( key_of_rank.begin(), key_of_rank.end(), 0 );
+    std::shuffle( key_of_rank.begin(), key_of_rank.end(), gen );
+
+    std::uniform_real_distribution< double > uniform( 0.0, cdf.back() );
+    std::vector< size_t > trace( n_lookups );
+    for( auto & key : trace )
+    {
+        size_t rank = std::lower_bound( cdf.begin(), cdf.end(), uniform( gen ) ) - cdf.begin();
+        key = key_of_rank[ std::min( rank, n - 1 ) ];
+    }
+
+    return trace;
+}
+
+//! Looks up every key of the trace, returning a checksum so that the work is not optimized away.
+size_t run_lookups( const tree_type & tree, const std::vector< size_t > & trace )
+{
+    size_t checksum{0};
+    size_t value{0};
+    for( const auto & key : trace )
+        if( tree.retrieve( key, value ) )
+            checksum += value;
+
+    return checksum;
+}
+
+int main( int argc, char * argv[] )
+{
+    size_t n = argc > 1 ? std::atol( argv[1] ) : 1 << 20;
+    size_t n_lookups = argc > 2 ? std::atol( argv[2] ) : 4 << 20;
+    size_t n_large = argc > 3 ? std::atol( argv[3] ) : 4 << 20; // 128 MiB of nodes, larger than most LLCs.
+
+    std::mt19937 gen( 2024 );
+    auto less = []( const size_t & a, const size_t & b ) { return a < b; };
+
+    std::cout << ">>> " << n << " keys, " << n_lookups << " lookups, " << n_large << " keys in the large tree.\n";
+
+    {
+        std::cout << "\n>>> Access policy on a Zipfian trace (s = 0.99):\n";
+
+        tree_type static_tree( less );
+        fill( static_tree, n, gen );
+        tree_type splay_tree( static_tree );
+        splay_tree.set_access_policy( tree_type::AccessPolicy::SPLAY );
+        tree_type cached_tree( static_tree );
+        cached_tree.enable_lookup_cache( 4096 );
+
+        auto trace = zipf_trace( n, n_lookups, 0.99, gen );
+
+        size_t sum_static{0}, sum_splay{0}, sum_cached{0};
+        report( "static", ns_per_op( n_lookups, [&]{ sum_static = run_lookups( static_tree, trace ); } ) );
+        report( "splay", ns_per_op( n_lookups, [&]{ sum_splay = run_lookups( splay_tree, trace ); } ) );
+        report( "static + 4096-slot lookup cache", ns_per_op( n_lookups, [&]{ sum_cached = run_lookups( cached_tree, trace ); } ) );
+        std::cout << "  cache hit rate: " << std::setprecision(3)
+                  << double( cached_tree.cache_hits() ) / n_lookups << "\n";
+
+        if( sum_static != sum_splay or sum_static != sum_cached )
+        {
+            std::cout << "Checksum mismatch!\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        // Sorted input degrades a plain BST into a list, so keep this one small.
+        size_t n_stream = std::min< size_t >( n, 1 << 14 );
+        std::cout << "\n>>> Nearly sorted stream of " << n_stream << " keys (shuffled by blocks of 16):\n";
+
+        std::vector< size_t > keys( n_stream );
+        std::iota( keys.begin(), keys.end(), 0 );
+        for( size_t first = 0 ; first < n_stream ; first += 16 )
+            std::shuffle( keys.begin() + first, keys.begin() + std::min( first + 16, n_stream ), gen );
+
+        tree_type plain( less ), hinted( less ), rebalanced( less );
+        rebalanced.enable_incremental_rebalance();
+        report( "insert", ns_per_op( n_stream, [&]{ for( const auto & k : keys ) plain.insert( k, k ); } ) );
+        report( "insert_hint", ns_per_op( n_stream, [&]{ for( const auto & k : keys ) hinted.insert_hint( k, k ); } ) );
+        report( "insert, incremental rebalancing", ns_per_op( n_stream, [&]{ for( const auto & k : keys ) rebalanced.insert( k, k ); } ) );
+        std::cout << "  heights: " << plain.height() << " without rebalancing, " << rebalanced.height() << " with it"
+                  << ( rebalanced.rebalancing() ? " (in the middle of a rebalance)\n" : "\n" );
+        report( "rebalance(), per node", ns_per_op( n_stream, [&]{ plain.rebalance(); } ) );
+
+        size_t sum_plain{0}, sum_hinted{0};
+        plain.inorder( [&]( const size_t & v ) { sum_plain += v; } );
+        hinted.inorder( [&]( const size_t & v ) { sum_hinted += v; } );
+        if( sum_plain != sum_hinted or plain.size() != hinted.size() )
+        {
+            std::cout << "Checksum mismatch!\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        std::cout << "\n>>> Building a tree from " << n << " unsorted pairs (" << std::thread::hardware_concurrency() << " hardware threads):\n";
+
+        std::vector< std::pair< size_t, size_t > > pairs( n );
+        for( size_t i = 0 ; i < n ; ++i )
+            pairs[i] = std::make_pair( i, i );
+        std::shuffle( pairs.begin(), pairs.end(), gen );
+
+        size_t size_inserted{0}, size_built{0};
+        report( "insert() one by one", ns_per_op( n, [&]
+        {
+            tree_type tree( less );
+            for( const auto & p : pairs )
+                tree.insert( p.first, p.second );
+            size_inserted = tree.size();
+        } ) );
+        report( "range constructor", ns_per_op( n, [&]
+        {
+            tree_type tree( pairs.begin(), pairs.end(), less );
+            size_built = tree.size();
+        } ) );
+
+        if( size_inserted != n or size_built != n )
+        {
+            std::cout << "Size mismatch!\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        unsigned n_threads = std::max( 2u, std::thread::hardware_concurrency() );
+        std::cout << "\n>>> Copies of a random tree:\n";
+
+        tree_type source( less );
+        fill( source, n, gen );
+
+        tree_type copy( source );
+        report( "copy constructor and destructor", ns_per_op( n, [&]{ tree_type fresh( source ); } ) );
+        report( "assignment, reusing the nodes", ns_per_op( n, [&]{ copy = source; } ) );
+        report( "assign() with " + std::to_string( n_threads ) + " threads", ns_per_op( n, [&]{ copy.assign( source, n_threads ); } ) );
+
+        size_t sum_source{0}, sum_copy{0};
+        source.inorder( [&]( const size_t & v ) { sum_source += v; } );
+        copy.inorder( [&]( const size_t & v ) { sum_copy += v; } );
+        if( sum_source != sum_copy )
+        {
+            std::cout << "Checksum mismatch!\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        unsigned n_threads = std::max( 2u, std::thread::hardware_concurrency() );
+        std::cout << "\n>>> Inserting " << n << " random keys from " << n_threads << " threads ("
+                  << std::thread::hardware_concurrency() << " hardware threads):\n";
+
+        std::vector< size_t > keys( n );
+        std::iota( keys.begin(), keys.end(), 0 );
+        std::shuffle( keys.begin(), keys.end(), gen );
+
+        // Each thread inserts an interleaved slice of the keys.
+        auto run_writers = [&]( const std::function< void( size_t ) > & insert )
+        {
+            std::vector< std::thread > writers;
+            for( unsigned t = 0 ; t < n_threads ; ++t )
+                writers.emplace_back( [&, t]{ for( size_t i = t ; i < n ; i += n_threads ) insert( keys[i] ); } );
+            for( auto & writer : writers )
+                writer.join();
+        };
+
+        tree_type locked( less );
+        std::mutex lock;
+        report( "BST behind a single mutex", ns_per_op( n, [&]
+        {
+            run_writers( [&]( size_t k ) { std::lock_guard< std::mutex > guard( lock ); locked.insert( k, k ); } );
+        } ) );
+
+        ShardedBST< size_t, size_t > sharded( 4 * n_threads, less );
+        report( "ShardedBST, " + std::to_string( 4 * n_threads ) + " shards by hash", ns_per_op( n, [&]
+        {
+            run_writers( [&]( size_t k ) { sharded.insert( k, k ); } );
+        } ) );
+
+        if( locked.size() != n or sharded.size() != n )
+        {
+            std::cout << "Size mismatch!\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        std::cout << "\n>>> Memory of a random tree of " << n << " keys (KiB):\n";
+
+        auto print_usage = []( const std::string & label, const tree_type::MemoryUsage & usage )
+        {
+            std::cout << "  " << std::left << std::setw(28) << label << std::right
+                      << " payload " << std::setw(7) << usage.payload / 1024
+                      << ", pointers " << std::setw(7) << usage.pointers / 1024
+                      << ", padding " << std::setw(5) << usage.padding / 1024
+                      << ", slack " << std::setw(7) << usage.slack / 1024
+                      << ", total " << std::setw(7) << usage.total() / 1024 << "\n";
+        };
+
+        tree_type tree( less );
+        fill( tree, n, gen );
+        print_usage( "after insertions", tree.memory_usage() );
+        for( size_t k = 0 ; k < n ; ++k )
+            if( k % 10 != 0 )
+                tree.remove( k );
+        print_usage( "after removing 90% of them", tree.memory_usage() );
+        report( "shrink_to_fit(), per node left", ns_per_op( tree.size(), [&]{ tree.shrink_to_fit(); } ) );
+        print_usage( "after shrink_to_fit()", tree.memory_usage() );
+    }
+
+    {
+#ifdef BST_DISABLE_PREFETCH
+        std::cout << "\n>>> Uniform lookups in a tree larger than the LLC (prefetching disabled):\n";
+#else
+        std::cout << "\n>>> Uniform lookups in a tree larger than the LLC (prefetching enabled):\n";
+#endif
+
+        tree_type large( less );
+        fill( large, n_large, gen );
+
+        std::uniform_int_distribution< size_t > any_key( 0, 2 * n_large - 1 ); // About half of them miss.
+        std::vector< size_t > trace( n_lookups );
+        for( auto & key : trace )
+            key = any_key( gen );
+
+        size_t sum{0};
+        report( "retrieve", ns_per_op( n_lookups, [&]{ sum = run_lookups( large, trace ); } ) );
+        size_t n_found{0};
+        report( "contains", ns_per_op( n_lookups, [&]{ for( const auto & key : trace ) n_found += large.contains( key ); } ) );
+        std::cout << "  checksum: " << sum << ", found: " << n_found << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -6,8 +6,19 @@
 #include <cassert>
 #include <vector>
 #include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <memory>
+#include <cmath>
 
 #include "../include/bst.h"
+#include "../include/compact_bst.h"
+#include "../include/multi_bst.h"
+#include "../include/interval_bst.h"
+#include "../include/sharded_bst.h"
 
 template<class T>
 void print(const T &arg)
@@ -15,6 +26,34 @@ void print(const T &arg)
     std::cout << arg << std::endl;
 }
 
+// A comparator that compares std::string keys with C strings directly.
+struct StringLess {
+    typedef void is_transparent;
+    bool operator()( const std::string & a, const std::string & b ) const { return a < b; }
+    bool operator()( const std::string & a, const char * b ) const { return a.compare( b ) < 0; }
+    bool operator()( const char * a, const std::string & b ) const { return b.compare( a ) > 0; }
+};
+
+// A value whose copies fail on demand. Its moves are copies, so they may throw too.
+struct FragileValue {
+    static int copies_left; // The copy that finds it at 0 throws; negative means no limit.
+    int value;
+    FragileValue( int v = 0 ) : value( v ) { }
+    FragileValue( const FragileValue & other ) : value( other.value )
+    {
+        if( copies_left-- == 0 )
+            throw std::runtime_error( "FragileValue: copy failed" );
+    }
+    FragileValue & operator=( const FragileValue & ) = default;
+};
+int FragileValue::copies_left = -1;
+
+// A stateful visitor: its call operator is not `const`.
+struct Counter {
+    size_t n_visited = 0;
+    void operator()( const size_t & ) { n_visited++; }
+};
+
 int main()
 {
     auto n_unit{0}; // unit test count.
@@ -307,6 +346,1207 @@ int main()
 	        std::cout << ">>> Passed!\n\n";
     	}
 
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": level order traversal.\n";
+	        // The tree
+	        BST< size_t, size_t > tree( compare_keys );
+
+	        for( const auto & k : { 5, 2, 8, 1, 3, 7, 9 } )
+	            tree.insert( k, k );
+
+	        std::vector< size_t > level_vec = { 5, 2, 8, 1, 3, 7, 9 };
+	        std::vector< size_t > vec;
+	        tree.levelorder( [&]( const size_t & data_ ) { vec.push_back( data_ ); } );
+	        assert( vec == level_vec );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": early traversal termination.\n";
+	        // The tree
+	        BST< size_t, size_t > tree( compare_keys );
+
+	        for( const auto & k : { 5, 2, 8, 1, 3, 7, 9 } )
+	            tree.insert( k, k );
+
+	        // Stop as soon as three values have been seen.
+	        std::vector< size_t > vec;
+	        auto take_three = [&]( const size_t & data_ )-> bool
+	        {
+	            vec.push_back( data_ );
+	            return vec.size() < 3;
+	        };
+
+	        tree.preorder( take_three );
+	        assert( ( vec == std::vector< size_t >{ 5, 2, 1 } ) );
+
+	        vec.clear();
+	        tree.inorder( take_three );
+	        assert( ( vec == std::vector< size_t >{ 1, 2, 3 } ) );
+
+	        vec.clear();
+	        tree.postorder( take_three );
+	        assert( ( vec == std::vector< size_t >{ 1, 3, 2 } ) );
+
+	        vec.clear();
+	        tree.levelorder( take_three );
+	        assert( ( vec == std::vector< size_t >{ 5, 2, 8 } ) );
+
+	        // find_if() stops at the first match.
+	        size_t n_tested{0};
+	        auto found = tree.find_if( [&]( const size_t & data_ ) { ++n_tested; return data_ > 4; } );
+	        assert( found != nullptr and *found == 5 );
+	        assert( n_tested == 4 );
+	        assert( tree.find_if( []( const size_t & data_ ) { return data_ > 100; } ) == nullptr );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": range query.\n";
+	        // The tree, with the usual "less than" ordering.
+	        BST< size_t, size_t > tree( []( const size_t &a, const size_t &b ) { return a < b; } );
+
+	        for( const auto & k : { 10, 4, 15, 2, 7, 12, 18, 1, 3, 6, 8, 11, 13, 17, 19 } )
+	            tree.insert( k, k );
+
+	        std::vector< size_t > vec;
+	        tree.for_each_in_range( 6, 12, [&]( const size_t & data_ ) { vec.push_back( data_ ); } );
+	        std::sort( vec.begin(), vec.end() );
+	        assert( ( vec == std::vector< size_t >{ 6, 7, 8, 10, 11, 12 } ) );
+
+	        // Bounds that are not stored in the tree.
+	        vec.clear();
+	        tree.for_each_in_range( 14, 16, [&]( const size_t & data_ ) { vec.push_back( data_ ); } );
+	        assert( ( vec == std::vector< size_t >{ 15 } ) );
+
+	        // Early termination.
+	        vec.clear();
+	        tree.for_each_in_range( 1, 19, [&]( const size_t & data_ ) { vec.push_back( data_ ); return vec.size() < 2; } );
+	        assert( vec.size() == 2 );
+
+	        // Empty range.
+	        vec.clear();
+	        tree.for_each_in_range( 12, 6, [&]( const size_t & data_ ) { vec.push_back( data_ ); } );
+	        assert( vec.empty() );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": range deletion.\n";
+	        // The tree
+	        BST< size_t, size_t > tree( compare_keys );
+
+	        for( const auto & k : { 10, 4, 15, 2, 7, 12, 18, 1, 3, 6, 8, 11, 13, 17, 19 } )
+	            tree.insert( k, k );
+
+	        // compare_keys sorts keys in decreasing order, so the range goes from 12 down to 6.
+	        assert( tree.erase_range( 12, 6 ) == 6 );
+	        assert( tree.size() == 9 );
+	        for( const auto & k : { 6, 7, 8, 10, 11, 12 } )
+	            assert( not tree.contains( k ) );
+	        for( const auto & k : { 1, 2, 3, 4, 13, 15, 17, 18, 19 } )
+	            assert( tree.contains( k ) );
+
+	        // The remaining nodes still form a valid BST.
+	        std::vector< size_t > vec;
+	        tree.inorder( [&]( const size_t & data_ ) { vec.push_back( data_ ); } );
+	        assert( ( vec == std::vector< size_t >{ 1, 2, 3, 4, 13, 15, 17, 18, 19 } ) );
+
+	        assert( tree.erase_range( 100, 50 ) == 0 );
+	        assert( tree.erase_range( 19, 0 ) == 9 );
+	        assert( tree.empty() );
+
+	        // Joining the parts back adds at most one level, so repeated deletions in the
+	        // middle of a balanced tree (14 levels) keep it shallow.
+	        std::vector< std::pair< size_t, size_t > > pairs;
+	        for( size_t k = 0 ; k < 8192 ; ++k )
+	            pairs.emplace_back( k, k );
+	        BST< size_t, size_t > big( pairs.begin(), pairs.end(), compare_keys );
+	        std::vector< bool > present( 8192, true );
+	        std::mt19937 gen( 5 );
+	        for( size_t i = 0 ; i < 1000 ; ++i )
+	        {
+	            size_t lo = 2000 + gen() % 4000;
+	            size_t n_present = std::count( present.begin() + lo, present.begin() + lo + 4, true );
+	            assert( big.erase_range( lo + 3, lo ) == n_present );
+	            std::fill( present.begin() + lo, present.begin() + lo + 4, false );
+	            assert( big.height() <= 32 );
+	        }
+	        assert( big.size() == size_t( std::count( present.begin(), present.end(), true ) ) );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": key-value traversal.\n";
+	        // The tree
+	        BST< size_t, std::string > tree( compare_keys );
+
+	        for( const auto & k : { 5, 2, 8, 1, 3, 7, 9 } )
+	            tree.insert( k, std::string( k, '*' ) );
+
+	        // Keys and values are handed out together.
+	        std::vector< size_t > keys;
+	        tree.inorder( [&]( const size_t & key, const std::string & value )
+	        {
+	            assert( value.size() == key );
+	            keys.push_back( key );
+	        } );
+	        assert( ( keys == std::vector< size_t >{ 1, 2, 3, 5, 7, 8, 9 } ) );
+
+	        // In place update of the values.
+	        tree.preorder( [&]( const size_t & key, std::string & value ) { value = std::to_string( key ); } );
+	        tree.for_each_in_range( 8, 3, []( std::string & value ) { value += "!"; } );
+
+	        const auto & const_tree = tree;
+	        std::vector< std::string > values;
+	        const_tree.levelorder( [&]( const size_t &, const std::string & value ) { values.push_back( value ); } );
+	        assert( ( values == std::vector< std::string >{ "5!", "2", "8!", "1", "3!", "7!", "9" } ) );
+
+	        // Key-value visitors may stop the traversal too.
+	        keys.clear();
+	        const_tree.postorder( [&]( const size_t & key, const std::string & ) { keys.push_back( key ); return key != 3; } );
+	        assert( ( keys == std::vector< size_t >{ 1, 3 } ) );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": find, at, operator[] and get_or_insert.\n";
+	        // The tree
+	        BST< size_t, std::string > tree( compare_keys );
+
+	        for( const auto & e : data )
+	            tree.insert( e.first, std::to_string( e.second ) );
+
+	        // find() hands out the stored value, no copy involved.
+	        auto value = tree.find( 3 );
+	        assert( value != nullptr and *value == "3" );
+	        *value = "three";
+	        assert( tree.at( 3 ) == "three" );
+	        assert( tree.find( 42 ) == nullptr );
+
+	        bool thrown{ false };
+	        try { tree.at( 42 ); }
+	        catch( const std::out_of_range & ) { thrown = true; }
+	        assert( thrown );
+
+	        // operator[] inserts a default value for missing keys only.
+	        assert( tree[ 4 ] == "4" );
+	        assert( tree[ 42 ].empty() );
+	        assert( tree.size() == 12 );
+	        tree[ 42 ] = "forty-two";
+	        assert( tree.at( 42 ) == "forty-two" );
+
+	        // get_or_insert() does not overwrite existing values.
+	        assert( tree.get_or_insert( 42, "other" ) == "forty-two" );
+	        tree.get_or_insert( 43, "forty-three" ) += "!";
+	        assert( tree.at( 43 ) == "forty-three!" );
+	        assert( tree.size() == 13 );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": compact tree.\n";
+	        // Same shape as the regular tree for the same insertions.
+	        BST< uint32_t, uint32_t > tree( []( const uint32_t &a, const uint32_t &b ) { return a > b; } );
+	        CompactBST< uint32_t, uint32_t > compact( []( const uint32_t &a, const uint32_t &b ) { return a > b; } );
+
+	        std::vector< uint32_t > keys( 200 );
+	        std::iota( keys.begin(), keys.end(), 0 );
+	        std::shuffle( keys.begin(), keys.end(), std::mt19937( 7 ) );
+	        for( const auto & k : keys )
+	        {
+	            tree.insert( k, k * 2 );
+	            compact.insert( k, k * 2 );
+	        }
+	        assert( compact.size() == tree.size() );
+
+	        std::vector< uint32_t > expected, vec;
+	        auto capture = [&]( std::vector< uint32_t > & v ) { return [&v]( const uint32_t & data_ ) { v.push_back( data_ ); }; };
+	        tree.preorder( capture( expected ) );
+	        compact.preorder( capture( vec ) );
+	        assert( vec == expected );
+
+	        // Removal, with released nodes being recycled.
+	        for( uint32_t k = 0 ; k < 200 ; k += 3 )
+	        {
+	            tree.remove( k );
+	            compact.remove( k );
+	        }
+	        compact.remove( 1000 );
+	        for( uint32_t k = 1000 ; k < 1050 ; ++k )
+	        {
+	            tree.insert( k, k );
+	            compact.insert( k, k );
+	        }
+	        assert( compact.size() == tree.size() );
+	        expected.clear(); vec.clear();
+	        tree.postorder( capture( expected ) );
+	        compact.postorder( capture( vec ) );
+	        assert( vec == expected );
+	        expected.clear(); vec.clear();
+	        tree.levelorder( capture( expected ) );
+	        compact.levelorder( capture( vec ) );
+	        assert( vec == expected );
+
+	        // Lookups.
+	        assert( compact.find_min() == tree.find_min() );
+	        assert( compact.find_max() == tree.find_max() );
+	        assert( compact.contains( 1 ) and not compact.contains( 3 ) );
+	        uint32_t value;
+	        assert( compact.retrieve( 1, value ) and value == 2 );
+	        assert( compact.at( 2 ) == 4 and compact.find( 3 ) == nullptr );
+	        compact[ 3 ] = 33;
+	        assert( compact.get_or_insert( 3, 0 ) == 33 );
+
+	        // In place updates through a key-value visitor, stopping early.
+	        size_t n_visited{0};
+	        compact.inorder( [&]( const uint32_t & key, uint32_t & data_ ) { data_ = key; return ++n_visited < 10; } );
+	        assert( n_visited == 10 );
+
+	        // Copies are independent.
+	        auto copy = compact;
+	        compact.clear();
+	        assert( compact.empty() and not compact.contains( 1 ) );
+	        assert( copy.contains( 1 ) and copy.size() == tree.size() + 1 );
+
+	        CompactBST< uint32_t, uint32_t > init( { { 2, 2 }, { 1, 1 }, { 2, 3 } }, []( const uint32_t &a, const uint32_t &b ) { return a < b; } );
+	        assert( init.size() == 2 and init.at( 2 ) == 2 );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": compact tree mirrors the regular tree.\n";
+	        // The same random sequence of operations, applied to both trees, gives the same results.
+	        auto greater = []( const uint32_t &a, const uint32_t &b ) { return a > b; };
+	        BST< uint32_t, uint32_t > tree( greater );
+	        CompactBST< uint32_t, uint32_t > compact( greater );
+
+	        auto same_value = []( const uint32_t * a, const uint32_t * b ) { return a == b or ( a != nullptr and b != nullptr and *a == *b ); };
+	        auto capture = [&]( std::vector< uint32_t > & v ) { return [&v]( const uint32_t & key, const uint32_t & data_ ) { v.push_back( key ); v.push_back( data_ ); }; };
+	        auto sum_chunks = [&]( uint64_t & sum ) { return [&sum]( const uint32_t * const * values, size_t n ) { for( size_t i = 0 ; i < n ; ++i ) sum = sum * 31 + *values[i]; }; };
+
+	        std::mt19937 gen( 11 );
+	        uint32_t hint = 0;
+	        for( size_t op = 0 ; op < 20000 ; ++op )
+	        {
+	            uint32_t k = gen() % 2000;
+	            uint32_t w = gen() % 16;
+	            uint32_t v = gen();
+	            switch( gen() % 8 )
+	            {
+	                case 0: tree.insert( k, v ); compact.insert( k, v ); break;
+	                case 1: hint = ( hint + w ) % 2000; tree.insert_hint( hint, v ); compact.insert_hint( hint, v ); break;
+	                case 2: tree.remove( k ); compact.remove( k ); break;
+	                case 3: assert( compact.erase_range( k + w, k ) == tree.erase_range( k + w, k ) ); break;
+	                case 4: assert( same_value( compact.lower_bound( k ), tree.lower_bound( k ) ) ); break;
+	                case 5: assert( same_value( compact.find( k ), tree.find( k ) ) ); break;
+	                case 6:
+	                {
+	                    std::vector< uint32_t > expected, vec;
+	                    tree.for_each_in_range( k + 4 * w, k, capture( expected ) );
+	                    compact.for_each_in_range( k + 4 * w, k, capture( vec ) );
+	                    assert( vec == expected );
+	                    break;
+	                }
+	                default: assert( same_value( compact.find_if( [&]( const uint32_t & data_ ) { return data_ % 64 == w; } ),
+	                                             tree.find_if( [&]( const uint32_t & data_ ) { return data_ % 64 == w; } ) ) );
+	            }
+	            assert( compact.size() == tree.size() );
+
+	            if( op % 1000 == 0 )
+	            {
+	                std::vector< uint32_t > expected, vec;
+	                tree.preorder( capture( expected ) );
+	                compact.preorder( capture( vec ) );
+	                assert( vec == expected );
+	                uint64_t expected_sum = 0, sum = 0;
+	                tree.inorder_chunks( sum_chunks( expected_sum ) );
+	                compact.inorder_chunks( sum_chunks( sum ) );
+	                assert( sum == expected_sum );
+	            }
+	        }
+
+	        // Heterogeneous lookups.
+	        BST< std::string, size_t > words( StringLess{} );
+	        CompactBST< std::string, size_t > compact_words( StringLess{} );
+	        for( const auto & w : { "kiwi", "apple", "pear", "fig", "banana", "plum" } )
+	        {
+	            words.insert( w, std::string( w ).size() );
+	            compact_words.insert( w, std::string( w ).size() );
+	        }
+	        for( const char * w : { "fig", "grape", "banana", "a", "zzz" } )
+	        {
+	            size_t expected{0}, value{0};
+	            assert( compact_words.contains( w, StringLess{} ) == words.contains( w, StringLess{} ) );
+	            assert( compact_words.retrieve( w, value, StringLess{} ) == words.retrieve( w, expected, StringLess{} ) and value == expected );
+	            const size_t * bound = compact_words.lower_bound( w, StringLess{} );
+	            const size_t * expected_bound = words.lower_bound( w, StringLess{} );
+	            assert( bound == expected_bound or ( bound != nullptr and expected_bound != nullptr and *bound == *expected_bound ) );
+	            compact_words.remove( w, StringLess{} );
+	            words.remove( w, StringLess{} );
+	            assert( compact_words.size() == words.size() and compact_words.find( w, StringLess{} ) == nullptr );
+	        }
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": lower bound and heterogeneous lookup.\n";
+	        BST< std::string, size_t > tree( StringLess{} );
+	        for( const auto & w : { "kiwi", "apple", "pear", "fig", "banana", "plum" } )
+	            tree.insert( w, std::string( w ).size() );
+
+	        assert( tree.contains( "fig", StringLess{} ) );
+	        assert( not tree.contains( "grape", StringLess{} ) );
+
+	        size_t value{0};
+	        assert( tree.retrieve( "banana", value, StringLess{} ) and value == 6 );
+	        assert( not tree.retrieve( "cherry", value, StringLess{} ) );
+
+	        auto found = tree.find( "pear", StringLess{} );
+	        assert( found != nullptr and *found == 4 );
+	        *found = 40;
+	        assert( tree.at( "pear" ) == 40 );
+
+	        // lower_bound() follows the order of the comparator.
+	        assert( *tree.lower_bound( "c", StringLess{} ) == 3 ); // fig
+	        assert( *tree.lower_bound( "kiwi", StringLess{} ) == 4 ); // kiwi
+	        assert( *tree.lower_bound( std::string( "apple" ) ) == 5 ); // apple
+	        assert( tree.lower_bound( "zebra", StringLess{} ) == nullptr );
+
+	        tree.remove( "kiwi", StringLess{} );
+	        tree.remove( "grape", StringLess{} );
+	        assert( tree.size() == 5 and not tree.contains( "kiwi" ) );
+	        tree.remove( "apple", StringLess{} ); // Node with two children.
+	        assert( tree.size() == 4 and not tree.contains( "apple" ) );
+	        for( const auto & w : { "pear", "fig", "banana", "plum" } )
+	            assert( tree.contains( w, StringLess{} ) );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": van Emde Boas relayout.\n";
+	        // The tree
+	        BST< size_t, std::string > tree( compare_keys );
+	        tree.relayout(); // Nothing to do on an empty tree.
+
+	        std::vector< size_t > keys( 1000 );
+	        std::iota( keys.begin(), keys.end(), 0 );
+	        std::shuffle( keys.begin(), keys.end(), std::mt19937( 11 ) );
+	        for( const auto & k : keys )
+	            tree.insert( k, std::to_string( k ) );
+	        for( size_t k = 0 ; k < 1000 ; k += 7 )
+	            tree.remove( k );
+
+	        std::vector< size_t > pre_before, pre_after;
+	        tree.preorder( [&]( const size_t & key, const std::string & ) { pre_before.push_back( key ); } );
+
+	        tree.relayout();
+
+	        // Same shape and contents.
+	        tree.preorder( [&]( const size_t & key, const std::string & value )
+	        {
+	            assert( value == std::to_string( key ) );
+	            pre_after.push_back( key );
+	        } );
+	        assert( pre_after == pre_before );
+
+	        // The root comes first, and every node lives in a single block.
+	        const auto & const_tree = tree;
+	        const std::string * root_value = const_tree.find( pre_before.front() );
+	        const std::string * lowest = root_value;
+	        const std::string * highest = root_value;
+	        for( const auto & k : pre_before )
+	        {
+	            lowest = std::min( lowest, const_tree.find( k ), std::less< const std::string * >() );
+	            highest = std::max( highest, const_tree.find( k ), std::less< const std::string * >() );
+	        }
+	        assert( lowest == root_value );
+	        assert( static_cast< size_t >( highest - lowest ) < 2 * tree.size() );
+
+	        // The tree keeps working after the relayout.
+	        for( size_t k = 0 ; k < 1000 ; k += 7 )
+	            assert( not tree.contains( k ) );
+	        for( size_t k = 1000 ; k < 1100 ; ++k )
+	            tree.insert( k, std::to_string( k ) );
+	        for( size_t k = 1 ; k < 1100 ; k += 2 )
+	            tree.remove( k );
+	        tree.relayout();
+	        for( size_t k = 0 ; k < 1100 ; ++k )
+	            assert( tree.contains( k ) == ( k % 2 == 0 and ( k >= 1000 or k % 7 != 0 ) ) );
+
+	        auto copy = tree;
+	        tree.clear();
+	        assert( copy.contains( 2 ) and copy.size() > 0 );
+
+	        // The exact order of a perfect tree of height 4: the top half ( 8, 4, 12 ),
+	        // then the subtrees of height 2 hanging from it, from left to right.
+	        BST< size_t, std::string > perfect( compare_keys );
+	        for( size_t k : { 8, 4, 12, 2, 6, 10, 14, 1, 3, 5, 7, 9, 11, 13, 15 } )
+	            perfect.insert( k, std::to_string( k ) );
+	        perfect.relayout();
+	        const auto & const_perfect = perfect;
+	        std::vector< size_t > by_address( 15 );
+	        std::iota( by_address.begin(), by_address.end(), 1 );
+	        std::sort( by_address.begin(), by_address.end(), [&]( size_t a, size_t b )
+	        {
+	            return std::less< const std::string * >()( const_perfect.find( a ), const_perfect.find( b ) );
+	        } );
+	        std::vector< size_t > veb_expected = { 8, 4, 12, 2, 1, 3, 6, 5, 7, 10, 9, 11, 14, 13, 15 };
+	        assert( by_address == veb_expected );
+
+	        // A copy failing halfway leaves the tree as it was.
+	        BST< size_t, FragileValue > fragile( compare_keys );
+	        for( size_t k = 0 ; k < 100 ; ++k )
+	            fragile.insert( ( k * 37 ) % 100, FragileValue( int( k ) ) );
+	        std::vector< size_t > fragile_before, fragile_after;
+	        fragile.preorder( [&]( const size_t & key, const FragileValue & v ) { fragile_before.push_back( key * 1000 + v.value ); } );
+	        FragileValue::copies_left = 50;
+	        bool thrown = false;
+	        try { fragile.relayout(); } catch( const std::runtime_error & ) { thrown = true; }
+	        FragileValue::copies_left = -1;
+	        assert( thrown );
+	        fragile.preorder( [&]( const size_t & key, const FragileValue & v ) { fragile_after.push_back( key * 1000 + v.value ); } );
+	        assert( fragile_after == fragile_before );
+	        fragile.relayout();
+	        fragile_after.clear();
+	        fragile.preorder( [&]( const size_t & key, const FragileValue & v ) { fragile_after.push_back( key * 1000 + v.value ); } );
+	        assert( fragile_after == fragile_before );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": splay access policy.\n";
+	        typedef BST< size_t, size_t > tree_type;
+	        // The tree
+	        tree_type tree( compare_keys );
+	        assert( tree.access_policy() == tree_type::AccessPolicy::STATIC );
+
+	        std::vector< size_t > keys( 500 );
+	        std::iota( keys.begin(), keys.end(), 0 );
+	        std::shuffle( keys.begin(), keys.end(), std::mt19937( 3 ) );
+	        for( const auto & k : keys )
+	            tree.insert( k, k * 10 );
+
+	        std::vector< size_t > in_before;
+	        tree.inorder( [&]( const size_t & data_ ) { in_before.push_back( data_ ); } );
+
+	        tree.set_access_policy( tree_type::AccessPolicy::SPLAY );
+
+	        // Every lookup brings the key to the root.
+	        auto root_key = [&]() -> size_t
+	        {
+	            size_t key{0};
+	            tree.levelorder( [&]( const size_t & k, const size_t & ) { key = k; return false; } );
+	            return key;
+	        };
+	        std::mt19937 gen( 5 );
+	        for( auto i = 0 ; i < 2000 ; ++i )
+	        {
+	            size_t k = gen() % 600;
+	            size_t value{0};
+	            bool found = tree.retrieve( k, value );
+	            assert( found == ( k < 500 ) );
+	            if( found )
+	            {
+	                assert( value == k * 10 );
+	                assert( root_key() == k );
+	            }
+	        }
+	        assert( tree.contains( 42 ) and root_key() == 42 );
+	        assert( *tree.find( 7 ) == 70 and root_key() == 7 );
+	        assert( tree.at( 99 ) == 990 and root_key() == 99 );
+
+	        // Splaying keeps the order and the contents.
+	        std::vector< size_t > in_after;
+	        tree.inorder( [&]( const size_t & data_ ) { in_after.push_back( data_ ); } );
+	        assert( in_after == in_before );
+	        assert( tree.size() == 500 );
+
+	        // Mixed with updates.
+	        for( size_t k = 0 ; k < 500 ; k += 2 )
+	        {
+	            tree.remove( k );
+	            assert( not tree.contains( k ) and tree.contains( k + 1 ) );
+	        }
+	        assert( tree.size() == 250 );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": lookup cache.\n";
+	        // The tree
+	        BST< size_t, size_t > tree( compare_keys );
+	        for( const auto & k : { 50, 20, 80, 10, 30, 70, 90, 25, 35, 75 } )
+	            tree.insert( k, k + 1 );
+
+	        tree.enable_lookup_cache( 5 ); // Rounded up to 8 slots.
+	        assert( tree.cache_hits() == 0 and tree.cache_misses() == 0 );
+
+	        size_t value{0};
+	        assert( tree.retrieve( 30, value ) and value == 31 );
+	        assert( tree.cache_misses() == 1 );
+	        assert( tree.retrieve( 30, value ) and value == 31 );
+	        assert( tree.contains( 30 ) and *tree.find( 30 ) == 31 );
+	        assert( tree.cache_hits() == 3 );
+	        assert( not tree.contains( 31 ) and not tree.contains( 31 ) );
+
+	        // Warm up every key, then change the tree.
+	        for( const auto & k : { 50, 20, 80, 10, 30, 70, 90, 25, 35, 75 } )
+	            assert( tree.at( k ) == size_t( k + 1 ) );
+
+	        tree.remove( 30 ); // Two children: 25 moves into the node of 30.
+	        assert( not tree.contains( 30 ) );
+	        assert( tree.contains( 25 ) and tree.at( 25 ) == 26 );
+	        tree.remove( 10 );
+	        assert( not tree.contains( 10 ) );
+	        tree.insert( 10, 100 );
+	        assert( tree.at( 10 ) == 100 );
+
+	        assert( tree.erase_range( 80, 70 ) == 3 );
+	        assert( not tree.contains( 75 ) and not tree.contains( 80 ) );
+	        tree.relayout();
+	        for( const auto & k : { 50, 20, 10, 90, 25, 35 } )
+	            assert( tree.contains( k ) );
+
+	        // Together with splaying.
+	        tree.set_access_policy( BST< size_t, size_t >::AccessPolicy::SPLAY );
+	        for( auto i = 0 ; i < 3 ; ++i )
+	            for( const auto & k : { 50, 20, 10, 90, 25, 35 } )
+	                assert( tree.contains( k ) and not tree.contains( k + 1000 ) );
+
+	        // Copies get their own, empty, cache.
+	        auto copy = tree;
+	        assert( copy.cache_hits() == 0 and copy.contains( 50 ) and copy.contains( 50 ) );
+	        assert( copy.cache_hits() == 1 );
+	        tree.clear();
+	        assert( not tree.contains( 50 ) and copy.contains( 50 ) );
+
+	        // Without a cache the counters stay still.
+	        tree.disable_lookup_cache();
+	        tree.insert( 1, 1 );
+	        auto hits = tree.cache_hits();
+	        assert( tree.contains( 1 ) and tree.contains( 1 ) );
+	        assert( tree.cache_hits() == hits );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": duplicate keys.\n";
+	        MultiBST< int, std::string > tree( { {5, "a"}, {3, "b"}, {5, "c"}, {8, "d"}, {5, "e"}, {3, "f"} }, compare_keys );
+	        assert( tree.size() == 6 );
+	        assert( tree.count( 5 ) == 3 and tree.count( 3 ) == 2 and tree.count( 4 ) == 0 );
+
+	        // Equal keys come out in insertion order.
+	        std::string values;
+	        tree.inorder( [&]( const std::string & v ) { values += v; } );
+	        assert( values == "bfaced" );
+	        values.clear();
+	        tree.equal_range( 5, [&]( const int & k, const std::string & v ) { assert( k == 5 ); values += v; } );
+	        assert( values == "ace" );
+
+	        // Values can be changed in place, and the visit can stop early.
+	        tree.equal_range( 5, []( std::string & v ) { v += "!"; } );
+	        size_t n_visited = 0;
+	        tree.equal_range( 5, [&]( const std::string & v ) { n_visited++; return v != "c!"; } );
+	        assert( n_visited == 2 );
+
+	        tree.insert( 5, "g" );
+	        assert( tree.erase_one( 5 ) and tree.count( 5 ) == 3 );
+	        assert( not tree.erase_one( 4 ) );
+	        assert( tree.erase_all( 3 ) == 2 and not tree.contains( 3 ) );
+	        assert( tree.erase_all( 5 ) == 3 and tree.size() == 1 and tree.contains( 8 ) );
+
+	        tree = { {1, "x"}, {1, "y"} };
+	        assert( tree.count( 1 ) == 2 and tree.size() == 2 and not tree.contains( 8 ) );
+
+	        // Hinted insertions keep duplicates too, after the equal keys already there.
+	        tree.insert_hint( 1, "z" );
+	        tree.insert_hint( 2, "p" );
+	        tree.insert( 1, "w" );
+	        tree.insert_hint( 1, "v" );
+	        tree.insert_hint( 0, "o" );
+	        tree.insert_hint( 2, "q" );
+	        values.clear();
+	        tree.inorder( [&]( const std::string & v ) { values += v; } );
+	        assert( tree.count( 1 ) == 5 and tree.count( 2 ) == 2 and values == "oxyzwvpq" );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": hinted insertion.\n";
+	        BST< size_t, size_t > tree( compare_keys );
+	        BST< size_t, size_t > reference( compare_keys );
+
+	        // A nearly sorted stream: sorted blocks of 8 keys, shuffled within each block.
+	        std::vector< size_t > keys( 200 );
+	        std::iota( keys.begin(), keys.end(), 0 );
+	        std::mt19937 gen( 7 );
+	        for( auto it = keys.begin() ; it != keys.end() ; it += 8 )
+	            std::shuffle( it, it + 8, gen );
+
+	        for( const auto & k : keys )
+	        {
+	            tree.insert_hint( k, k );
+	            reference.insert( k, k );
+	        }
+	        tree.insert_hint( 10, 0 ); // Already there.
+	        assert( tree.size() == 200 and tree.at( 10 ) == 10 );
+
+	        std::vector< size_t > got, expected;
+	        tree.inorder( [&]( const size_t & k, const size_t & ) { got.push_back( k ); } );
+	        reference.inorder( [&]( const size_t & k, const size_t & ) { expected.push_back( k ); } );
+	        assert( got == expected );
+
+	        // Plain insertions keep the finger, anything that moves nodes drops it.
+	        tree.insert( 500, 500 );
+	        tree.insert_hint( 201, 201 );
+	        tree.remove( 100 );
+	        tree.insert_hint( 100, 1 );
+	        assert( tree.erase_range( 50, 40 ) == 11 );
+	        tree.insert_hint( 45, 2 );
+	        tree.relayout();
+	        tree.insert_hint( 202, 3 );
+	        tree.set_access_policy( BST< size_t, size_t >::AccessPolicy::SPLAY );
+	        assert( tree.contains( 150 ) );
+	        tree.insert_hint( 203, 4 );
+	        assert( tree.size() == 194 and tree.at( 100 ) == 1 and tree.at( 45 ) == 2 and tree.at( 203 ) == 4 );
+	        got.clear();
+	        tree.inorder( [&]( const size_t & k, const size_t & ) { got.push_back( k ); } );
+	        assert( std::is_sorted( got.begin(), got.end() ) and got.size() == 194 );
+	        tree.clear();
+	        tree.insert_hint( 1, 1 );
+	        tree.insert_hint( 0, 0 );
+
+	        got.clear();
+	        tree.inorder( [&]( const size_t & k, const size_t & ) { got.push_back( k ); } );
+	        assert( got == std::vector< size_t >( { 0, 1 } ) );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": interval overlap queries.\n";
+	        auto less = []( const int & a, const int & b ) { return a < b; };
+	        IntervalBST< int, std::string > tree( { {{15, 20}, "a"}, {{10, 30}, "b"}, {{17, 19}, "c"},
+	                                               {{5, 20}, "d"}, {{12, 15}, "e"}, {{30, 40}, "f"}, {{10, 30}, "g"} }, less );
+	        assert( tree.size() == 7 );
+
+	        // Checks a query against a plain scan of every interval.
+	        auto check = [&]( const IntervalBST< int, std::string > & t, int lo, int hi )
+	        {
+	            std::string expected, got;
+	            t.inorder( [&]( const std::pair< int, int > & iv, const std::string & v )
+	                       { if( iv.first <= hi and lo <= iv.second ) expected += v; } );
+	            t.overlapping( lo, hi, [&]( const std::string & v ) { got += v; } );
+	            assert( got == expected );
+	            return got;
+	        };
+
+	        std::string found;
+	        tree.stabbing( 16, [&]( const std::string & v ) { found += v; } );
+	        std::sort( found.begin(), found.end() );
+	        assert( found == "abdg" );
+	        assert( check( tree, 41, 50 ).empty() and check( tree, 0, 4 ).empty() );
+	        assert( check( tree, 40, 40 ) == "f" );
+	        for( int lo = 0 ; lo < 45 ; lo += 3 )
+	            for( int hi = lo ; hi < 45 ; hi += 4 )
+	                check( tree, lo, hi );
+
+	        // Early termination.
+	        size_t n_visited = 0;
+	        tree.overlapping( 0, 50, [&]( const std::string & ) { return ++n_visited < 3; } );
+	        assert( n_visited == 3 );
+
+	        // The largest end points follow the removals.
+	        assert( tree.remove( 30, 40 ) and not tree.remove( 30, 40 ) );
+	        assert( check( tree, 31, 50 ).empty() );
+	        assert( tree.remove( 10, 30 ) and tree.remove( 10, 30 ) and tree.size() == 4 );
+	        assert( check( tree, 21, 50 ).empty() and check( tree, 20, 20 ).size() == 2 );
+	        assert( tree.remove( 15, 20 ) and check( tree, 0, 50 ).size() == 3 );
+
+	        // Random intervals against a plain scan, under copies and removals.
+	        std::mt19937 gen( 11 );
+	        std::uniform_int_distribution< int > point( 0, 1000 ), length( 0, 50 );
+	        IntervalBST< int, std::string > random_tree( less );
+	        std::vector< std::pair< int, int > > intervals;
+	        for( auto i = 0 ; i < 300 ; ++i )
+	        {
+	            int lo = point( gen );
+	            intervals.emplace_back( lo, lo + length( gen ) );
+	            random_tree.insert( intervals.back().first, intervals.back().second, std::to_string( i ) );
+	        }
+	        for( size_t i = 0 ; i < intervals.size() ; i += 2 )
+	            assert( random_tree.remove( intervals[i].first, intervals[i].second ) );
+	        auto copy = random_tree;
+	        random_tree.clear();
+	        assert( copy.size() == 150 and random_tree.empty() );
+	        for( int lo = 0 ; lo < 1100 ; lo += 37 )
+	            check( copy, lo, lo + 20 );
+
+	        // Time-ordered records come sorted, yet the tree stays shallow, and so do its copies.
+	        IntervalBST< int, int > timeline( less );
+	        for( int t = 0 ; t < 60000 ; ++t )
+	            timeline.insert( t, t + 9, t );
+	        assert( timeline.size() == 60000 and timeline.height() < 64 );
+	        IntervalBST< int, int > timeline_copy( timeline );
+	        for( int t = 0 ; t < 60000 ; t += 2 )
+	            assert( timeline.remove( t, t + 9 ) );
+	        assert( timeline.size() == 30000 and timeline.height() < 64 );
+	        size_t n_stabbed = 0;
+	        timeline.stabbing( 30000, [&]( const int & t ) { assert( t % 2 == 1 and t <= 30000 and t + 9 >= 30000 ); n_stabbed++; } );
+	        assert( n_stabbed == 5 );
+	        n_stabbed = 0;
+	        timeline_copy.stabbing( 30000, [&]( const int & ) { n_stabbed++; } );
+	        assert( n_stabbed == 10 and timeline_copy.height() < 64 );
+
+	        bool thrown = false;
+	        try { tree.insert( 5, 4, "x" ); } catch( const std::invalid_argument & ) { thrown = true; }
+	        assert( thrown );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": stateful and chunk visitors.\n";
+	        BST< size_t, size_t > tree( compare_keys );
+	        for( size_t k = 0 ; k < 150 ; ++k )
+	            tree.insert( ( k * 37 ) % 150, k );
+
+	        // The visitor is handed back after the traversal.
+	        assert( tree.inorder( Counter() ).n_visited == 150 );
+	        Counter counter;
+	        tree.preorder( counter );
+	        assert( counter.n_visited == 150 );
+	        assert( tree.for_each_in_range( 20, 10, counter ).n_visited == 161 );
+	        assert( counter.n_visited == 161 );
+
+	        // Chunks come in inorder.
+	        std::vector< size_t > values, chunked;
+	        tree.inorder( [&]( const size_t & v ) { values.push_back( v ); } );
+	        std::vector< size_t > chunk_sizes;
+	        tree.inorder_chunks( [&]( const size_t * const * chunk, size_t n )
+	        {
+	            chunk_sizes.push_back( n );
+	            for( size_t i = 0 ; i < n ; ++i )
+	                chunked.push_back( *chunk[i] );
+	        } );
+	        assert( chunked == values );
+	        assert( chunk_sizes == std::vector< size_t >( { 64, 64, 22 } ) );
+
+	        // Values may be updated in place, and a chunk visitor may stop the traversal.
+	        tree.inorder_chunks( []( size_t * const * chunk, size_t n )
+	        {
+	            for( size_t i = 0 ; i < n ; ++i )
+	                *chunk[i] *= 2;
+	        } );
+	        assert( tree.at( 37 ) == 2 );
+	        size_t n_chunks = 0;
+	        tree.inorder_chunks( [&]( const size_t * const *, size_t ) { return ++n_chunks < 2; } );
+	        assert( n_chunks == 2 );
+
+	        BST< size_t, size_t > empty_tree( compare_keys );
+	        empty_tree.inorder_chunks( [&]( const size_t * const *, size_t ) { n_chunks++; } );
+	        assert( n_chunks == 2 );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": copies.\n";
+	        // A degenerate tree, deeper than the call stack would allow.
+	        BST< size_t, size_t > chain( compare_keys );
+	        for( size_t k = 0 ; k < 200000 ; ++k )
+	            chain.insert_hint( k, k );
+	        BST< size_t, size_t > chain_copy( chain );
+	        assert( chain_copy.size() == 200000 and chain_copy.at( 199999 ) == 199999 );
+
+	        auto keys_of = []( const BST< size_t, std::string > & t )
+	        {
+	            std::vector< std::pair< size_t, std::string > > pairs;
+	            t.inorder( [&]( const size_t & k, const std::string & v ) { pairs.emplace_back( k, v ); } );
+	            return pairs;
+	        };
+
+	        // Assignments reuse the nodes of the target, whichever tree is larger.
+	        BST< size_t, std::string > small( compare_keys ), large( compare_keys );
+	        for( size_t k = 0 ; k < 10 ; ++k )
+	            small.insert( ( k * 7 ) % 10, std::string( 40, char( 'a' + k ) ) );
+	        for( size_t k = 0 ; k < 500 ; ++k )
+	            large.insert( ( k * 37 ) % 500, std::to_string( k ) );
+	        BST< size_t, std::string > target( small );
+	        target = large;
+	        assert( keys_of( target ) == keys_of( large ) );
+	        target = small;
+	        assert( keys_of( target ) == keys_of( small ) );
+	        target.insert( 100, "x" );
+	        target = target;
+	        assert( target.size() == 11 and target.at( 100 ) == "x" );
+
+	        // Parallel copies.
+	        BST< size_t, std::string > big( compare_keys );
+	        std::vector< size_t > big_keys( BST< size_t, std::string >::parallel_clone_threshold + 1000 );
+	        std::iota( big_keys.begin(), big_keys.end(), 0 );
+	        std::mt19937 gen( 5 );
+	        std::shuffle( big_keys.begin(), big_keys.end(), gen );
+	        for( const auto & k : big_keys )
+	            big.insert( k, std::to_string( k ) );
+	        target.assign( big, 4 );
+	        assert( keys_of( target ) == keys_of( big ) );
+	        target.remove( 10 );
+	        target.insert( 10, "ten" );
+	        assert( target.at( 10 ) == "ten" and target.size() == big.size() );
+	        target.assign( small, 4 ); // Too small to be worth threads.
+	        assert( keys_of( target ) == keys_of( small ) );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": bulk construction.\n";
+	        typedef std::vector< std::pair< size_t, size_t > > pairs_type;
+	        auto pairs_of = []( const BST< size_t, size_t > & t )
+	        {
+	            pairs_type pairs;
+	            t.inorder( [&]( const size_t & k, const size_t & v ) { pairs.emplace_back( k, v ); } );
+	            return pairs;
+	        };
+
+	        // The first of the pairs with equal keys wins, as with insertions.
+	        pairs_type input = { {4, 40}, {2, 20}, {4, 41}, {9, 90}, {1, 10}, {2, 21} };
+	        BST< size_t, size_t > tree( input.begin(), input.end(), compare_keys );
+	        assert( pairs_of( tree ) == pairs_type( { {1, 10}, {2, 20}, {4, 40}, {9, 90} } ) );
+
+	        // Perfectly balanced: 7 keys fill 3 levels.
+	        BST< size_t, size_t > full( { {6, 6}, {2, 2}, {4, 4}, {1, 1}, {3, 3}, {5, 5}, {7, 7} }, compare_keys );
+	        std::vector< size_t > levels;
+	        full.levelorder( [&]( const size_t & v ) { levels.push_back( v ); } );
+	        assert( levels == std::vector< size_t >( { 4, 2, 6, 1, 3, 5, 7 } ) );
+
+	        // Initializer list assignments replace the contents.
+	        full = { {8, 8}, {8, 80} };
+	        assert( pairs_of( full ) == pairs_type( { {8, 8} } ) );
+	        full.insert( 9, 9 );
+	        full.remove( 8 );
+	        assert( full.size() == 1 and full.at( 9 ) == 9 );
+	        full = {};
+	        assert( full.empty() );
+
+	        // Large inputs are sorted and built on several threads.
+	        pairs_type many;
+	        std::mt19937 gen( 3 );
+	        std::uniform_int_distribution< size_t > any_key( 0, BST< size_t, size_t >::parallel_build_threshold );
+	        BST< size_t, size_t > reference( compare_keys );
+	        for( size_t i = 0 ; i < BST< size_t, size_t >::parallel_build_threshold + 5000 ; ++i )
+	        {
+	            many.emplace_back( any_key( gen ), i );
+	            reference.insert( many.back().first, many.back().second );
+	        }
+	        BST< size_t, size_t > built( many.begin(), many.end(), compare_keys );
+	        assert( built.size() == reference.size() and pairs_of( built ) == pairs_of( reference ) );
+	        built.insert( 0, 1 );
+	        built.clear();
+	        assert( built.empty() );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": sharded trees.\n";
+	        typedef ShardedBST< size_t, size_t > sharded_type;
+	        auto keys_of = []( const sharded_type & t )
+	        {
+	            std::vector< size_t > keys;
+	            t.inorder( [&]( const size_t & k, const size_t & ) { keys.push_back( k ); } );
+	            return keys;
+	        };
+
+	        // Writers on several threads while the container is resharded under their feet.
+	        sharded_type sharded( 4, compare_keys );
+	        std::vector< std::thread > writers;
+	        for( size_t t = 0 ; t < 4 ; ++t )
+	            writers.emplace_back( [&sharded, t]
+	            {
+	                for( size_t k = t ; k < 4000 ; k += 4 )
+	                    sharded.insert( k, 2 * k );
+	                for( size_t k = t ; k < 4000 ; k += 8 )
+	                    sharded.remove( k );
+	            } );
+	        sharded.reshard( 3 );
+	        sharded.reshard( std::vector< size_t >( { 3000, 2000, 1000 } ) );
+	        for( auto & writer : writers )
+	            writer.join();
+
+	        assert( sharded.size() == 2000 and sharded.n_shards() == 4 );
+	        assert( sharded.partitioning() == sharded_type::Partitioning::RANGE );
+	        size_t value{0};
+	        assert( sharded.retrieve( 3999, value ) and value == 7998 );
+	        assert( not sharded.contains( 3992 ) and sharded.contains( 3996 ) );
+
+	        // Range partitioning yields the keys in order across shards.
+	        std::vector< size_t > expected;
+	        for( size_t k = 0 ; k < 4000 ; ++k )
+	            if( k % 8 >= 4 )
+	                expected.push_back( k );
+	        assert( keys_of( sharded ) == expected );
+
+	        std::vector< size_t > in_range;
+	        sharded.for_each_in_range( 2005, 990, [&]( const size_t & k, const size_t & ) { in_range.push_back( k ); } );
+	        assert( in_range == std::vector< size_t >( expected.begin() + 494, expected.begin() + 1002 ) );
+
+	        // A visitor that asks to stop is not called again, even in the following shards.
+	        size_t n_visited{0};
+	        sharded.for_each_in_range( 2005, 990, [&]( const size_t & ) { return ++n_visited < 3; } );
+	        assert( n_visited == 3 );
+
+	        // The values may be modified.
+	        sharded.for_each( []( size_t & v ) { v = 1; } );
+	        size_t sum{0};
+	        sharded.for_each( [&]( const size_t & v ) { sum += v; } );
+	        assert( sum == 2000 );
+
+	        // Back to hash partitioning: no ordered traversal.
+	        sharded.reshard( 7 );
+	        assert( sharded.size() == 2000 and sharded.n_shards() == 7 );
+	        bool thrown = false;
+	        try { keys_of( sharded ); } catch( const std::logic_error & ) { thrown = true; }
+	        assert( thrown );
+
+	        thrown = false;
+	        try { sharded.reshard( std::vector< size_t >( { 1000, 2000 } ) ); } catch( const std::invalid_argument & ) { thrown = true; }
+	        assert( thrown and sharded.n_shards() == 7 );
+
+	        sharded.clear();
+	        assert( sharded.empty() and sharded.size() == 0 );
+
+	        // Retired layouts are freed: the copies of the comparator held by their shards go away.
+	        auto token = std::make_shared< int >( 0 );
+	        {
+	            sharded_type resharded( 4, [token]( const size_t & a, const size_t & b ) { return a > b; } );
+	            auto n_copies = token.use_count();
+	            for( size_t i = 0 ; i < 100 ; ++i )
+	                resharded.reshard( 4 );
+	            assert( token.use_count() == n_copies );
+	        }
+	        assert( token.use_count() == 1 );
+
+	        // Readers keep finding every key, in order, while the keys move one shard at a time.
+	        sharded_type moving( std::vector< size_t >( { 3000, 2000, 1000 } ), compare_keys );
+	        std::vector< size_t > all_keys( 4000 );
+	        std::iota( all_keys.begin(), all_keys.end(), 0 );
+	        for( const auto & k : all_keys )
+	            moving.insert( k, k );
+	        std::atomic< bool > done{ false };
+	        std::vector< std::thread > readers;
+	        readers.emplace_back( [&]
+	        {
+	            while( not done )
+	                for( size_t k = 0 ; k < 4000 ; k += 37 )
+	                    assert( moving.contains( k ) );
+	        } );
+	        readers.emplace_back( [&]
+	        {
+	            while( not done )
+	            {
+	                assert( keys_of( moving ) == all_keys );
+	                assert( moving.size() == 4000 );
+	            }
+	        } );
+	        for( size_t i = 0 ; i < 10 ; ++i )
+	            moving.reshard( i % 2 == 0 ? std::vector< size_t >( { 3500, 2500, 1500, 500 } ) : std::vector< size_t >( { 2000 } ) );
+	        done = true;
+	        for( auto & reader : readers )
+	            reader.join();
+	        assert( keys_of( moving ) == all_keys and moving.n_shards() == 2 );
+
+	        // A move interrupted by an exception leaves every key reachable; the next reshard() completes it.
+	        ShardedBST< size_t, FragileValue > fragile( 3, compare_keys );
+	        for( size_t k = 0 ; k < 300 ; ++k )
+	            fragile.insert( k, FragileValue( int( k ) ) );
+	        FragileValue::copies_left = 250;
+	        thrown = false;
+	        try { fragile.reshard( 5 ); } catch( const std::runtime_error & ) { thrown = true; }
+	        FragileValue::copies_left = -1;
+	        assert( thrown and fragile.size() == 300 and fragile.n_shards() == 5 );
+	        for( size_t k = 0 ; k < 300 ; ++k )
+	        {
+	            FragileValue v;
+	            assert( fragile.retrieve( k, v ) and v.value == int( k ) );
+	        }
+	        fragile.reshard( std::vector< size_t >( { 200, 100 } ) );
+	        assert( fragile.size() == 300 and fragile.n_shards() == 3 );
+	        size_t n_fragile{0};
+	        fragile.inorder( [&]( const size_t & k, const FragileValue & v ) { assert( k == n_fragile++ and v.value == int( k ) ); } );
+	        assert( n_fragile == 300 );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": rebalancing.\n";
+	        typedef std::vector< std::pair< size_t, size_t > > pairs_type;
+	        auto pairs_of = []( const BST< size_t, size_t > & t )
+	        {
+	            pairs_type pairs;
+	            t.inorder( [&]( const size_t & k, const size_t & v ) { pairs.emplace_back( k, v ); } );
+	            return pairs;
+	        };
+
+	        // Sorted insertions build a vine, which rebalance() folds into 10 full levels.
+	        BST< size_t, size_t > tree( compare_keys );
+	        for( size_t k = 1 ; k <= 1000 ; ++k )
+	            tree.insert( k, 2 * k );
+	        assert( tree.height() == 1000 );
+	        const size_t * pinned = tree.find( 500 );
+	        auto before = pairs_of( tree );
+	        tree.rebalance();
+	        assert( tree.height() == 10 and pairs_of( tree ) == before );
+	        assert( tree.find( 500 ) == pinned and tree.at( 500 ) == 1000 );
+
+	        // Bulk builds are balanced from the start.
+	        BST< size_t, size_t > built( before.begin(), before.end(), compare_keys );
+	        assert( built.height() == 10 );
+
+	        // Incremental rebalancing: every operation does a few steps, until the tree is balanced.
+	        BST< size_t, size_t > vine( compare_keys );
+	        for( size_t k = 1 ; k <= 1000 ; ++k )
+	            vine.insert( k, 2 * k );
+	        vine.enable_incremental_rebalance( 2.0, 8 );
+	        size_t n_operations{0};
+	        do
+	        {
+	            vine.remove( 5000 ); // Not in the tree: only rebalancing work.
+	            n_operations++;
+	        } while( vine.rebalancing() and n_operations < 2000 );
+	        // A rebalance does enough steps per operation to be over within a few operations.
+	        size_t window = BST< size_t, size_t >::rebalance_window;
+	        assert( not vine.rebalancing() and n_operations > 1 and n_operations <= window );
+	        assert( vine.height() == 10 and pairs_of( vine ) == before );
+
+	        // A sorted stream: only the subtree that grew too tall is rebalanced, so the tree stays
+	        // within the limit whenever no rebalance is in progress, and short on average.
+	        BST< size_t, size_t > stream( compare_keys );
+	        stream.enable_incremental_rebalance( 2.0, 64 );
+	        size_t height_sum{0}, n_samples{0}, n_idle{0};
+	        for( size_t k = 1 ; k <= 10000 ; ++k )
+	        {
+	            stream.insert( k, 2 * k );
+	            if( k % 10 != 0 )
+	                continue;
+	            size_t h = stream.height();
+	            height_sum += h;
+	            n_samples++;
+	            if( not stream.rebalancing() )
+	            {
+	                n_idle++;
+	                assert( h <= 2 * std::log2( k + 1.0 ) );
+	            }
+	        }
+	        assert( n_idle > n_samples / 2 and height_sum / n_samples <= 5 * 14 );
+	        stream.rebalance();
+	        assert( stream.height() == 14 and stream.at( 5000 ) == 10000 );
+
+	        // Insertions and removals in the middle of a rebalance leave a valid tree.
+	        std::mt19937 gen( 7 );
+	        std::uniform_int_distribution< size_t > any_key( 1, 4000 );
+	        BST< size_t, size_t > mixed( compare_keys );
+	        std::vector< bool > present( 4001, false );
+	        for( size_t k = 1 ; k <= 2000 ; ++k )
+	        {
+	            mixed.insert( k, k );
+	            present[ k ] = true;
+	        }
+	        mixed.enable_incremental_rebalance( 2.0, 4 );
+	        bool started{false};
+	        for( size_t i = 0 ; i < 20000 ; ++i )
+	        {
+	            size_t k = any_key( gen );
+	            if( i % 3 == 0 )
+	            {
+	                mixed.remove( k );
+	                present[ k ] = false;
+	            }
+	            else
+	            {
+	                mixed.insert( k, k );
+	                present[ k ] = true;
+	            }
+	            started = started or mixed.rebalancing();
+	        }
+	        pairs_type expected;
+	        for( size_t k = 1 ; k <= 4000 ; ++k )
+	            if( present[ k ] )
+	                expected.emplace_back( k, k );
+	        assert( started and pairs_of( mixed ) == expected and mixed.size() == expected.size() );
+	        mixed.rebalance();
+	        BST< size_t, size_t > balanced( expected.begin(), expected.end(), compare_keys );
+	        assert( mixed.height() == balanced.height() );
+
+	        // Equal keys keep their order.
+	        MultiBST< size_t, size_t > multi( compare_keys );
+	        for( size_t i = 0 ; i < 300 ; ++i )
+	            multi.insert( i / 10, i );
+	        multi.rebalance();
+	        assert( multi.height() == 9 );
+	        for( size_t i = 300 ; i < 310 ; ++i )
+	            multi.insert( 5, i );
+	        std::vector< size_t > fives;
+	        multi.equal_range( 5, [&]( const size_t & v ) { fives.push_back( v ); } );
+	        std::vector< size_t > expected_fives( 10 );
+	        std::iota( expected_fives.begin(), expected_fives.end(), 50 );
+	        for( size_t i = 300 ; i < 310 ; ++i )
+	            expected_fives.push_back( i );
+	        assert( fives == expected_fives );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
+    	{
+	        std::cout << ">>> Unit teste #" << ++n_unit << ": memory usage.\n";
+	        BST< size_t, size_t > tree( compare_keys );
+	        for( size_t k = 0 ; k < 1000 ; ++k )
+	            tree.insert( ( k * 7919 ) % 1000, k );
+
+	        auto usage = tree.memory_usage();
+	        assert( usage.payload == 1000 * 2 * sizeof( size_t ) );
+	        assert( usage.pointers == 1000 * 2 * sizeof( void * ) );
+	        assert( usage.bookkeeping >= sizeof( tree ) );
+	        assert( usage.total() == usage.payload + usage.pointers + usage.padding + usage.slack + usage.bookkeeping );
+
+	        // A wave of removals leaves slack behind, until the tree shrinks to fit.
+	        for( size_t k = 0 ; k < 1000 ; ++k )
+	            if( k % 10 != 0 )
+	                tree.remove( k );
+	        auto after_removals = tree.memory_usage();
+	        assert( after_removals.payload == 100 * 2 * sizeof( size_t ) );
+	        assert( after_removals.slack >= 900 * ( 2 * sizeof( size_t ) + 2 * sizeof( void * ) ) );
+
+	        tree.shrink_to_fit();
+	        auto shrunk = tree.memory_usage();
+	        assert( shrunk.slack == 0 and shrunk.payload == after_removals.payload and shrunk.total() < after_removals.total() );
+	        assert( tree.size() == 100 and tree.contains( 990 ) and not tree.contains( 991 ) );
+	        tree.insert( 991, 1 );
+	        assert( tree.at( 991 ) == 1 );
+
+	        tree.clear();
+	        tree.shrink_to_fit();
+	        assert( tree.memory_usage().slack == 0 and tree.memory_usage().payload == 0 );
+
+	        std::cout << ">>> Passed!\n\n";
+    	}
+
     }
 		std::cout << "\n>>> Normal exiting...\n";	
     }